@@ -0,0 +1,920 @@
+// Copyright 2025 Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Standalone timings for the cycles device. Every mode builds a synthetic
+// scene through the public ANARI API, renders small single-sample frames and
+// prints one line per measurement. Run it next to the device library:
+//
+//   LD_LIBRARY_PATH=. ./anariCyclesBench [--verbose] <mode> [args...]
+//
+//   instances [counts...]  first sync and in-place update of one instance
+//                          holding N transforms (default 1k to 10M)
+//   animate [count] [frames]
+//                          per-frame latency while N single-transform
+//                          instances move every frame (default 10k, 100)
+//   formats [count]        memory, ingest and update time of N transforms
+//                          in every compact encoding against mat4 (1M)
+//   curves [count] [sides] memory and render time of N cylinders as native
+//                          curves against tubes tessellated with the given
+//                          number of sides (default 100k, 16)
+//   hdri [samples] [resolutions...]
+//                          noise of an HDRI-lit sphere at a fixed sample
+//                          count per importance map resolution (0 = auto)
+//
+// Heap allocations made while a measurement runs are counted on every
+// thread, including the device's and Cycles' own. A path which allocates
+// per object shows up as allocations growing with the instance count. On
+// glibc the live heap size is tracked too, so a measurement also reports how
+// much memory the device kept, e.g. converted arrays and BVHs.
+// --verbose echoes the device's debug-severity counters, e.g.
+// "anari_cycles::Instance updated N objects in place", next to the timings.
+
+#include <anari/anari.h>
+// std
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <vector>
+
+// Allocation counting ////////////////////////////////////////////////////////
+
+static std::atomic<bool> g_countAllocations{false};
+static std::atomic<size_t> g_numAllocations{0};
+static std::atomic<int64_t> g_liveBytes{0};
+
+static void countAllocation()
+{
+  if (g_countAllocations.load(std::memory_order_relaxed))
+    g_numAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef __GLIBC__
+// Interposing malloc also catches operator new and the aligned allocations
+// Cycles arrays use, in every library loaded into the process
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *p);
+
+// Live bytes are tracked by usable size, which free() can see as well
+static void *tracked(void *p)
+{
+  if (p)
+    g_liveBytes.fetch_add(int64_t(malloc_usable_size(p)));
+  return p;
+}
+
+static void untrack(void *p)
+{
+  if (p)
+    g_liveBytes.fetch_sub(int64_t(malloc_usable_size(p)));
+}
+
+void *malloc(size_t size) noexcept
+{
+  countAllocation();
+  return tracked(__libc_malloc(size));
+}
+
+void *calloc(size_t n, size_t size) noexcept
+{
+  countAllocation();
+  return tracked(__libc_calloc(n, size));
+}
+
+void *realloc(void *p, size_t size) noexcept
+{
+  countAllocation();
+  const auto oldSize = int64_t(p ? malloc_usable_size(p) : 0);
+  void *result = __libc_realloc(p, size);
+  if (result || size == 0) {
+    g_liveBytes.fetch_sub(oldSize);
+    tracked(result);
+  }
+  return result;
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size) noexcept
+{
+  countAllocation();
+  *p = tracked(__libc_memalign(alignment, size));
+  return *p || size == 0 ? 0 : ENOMEM;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept
+{
+  countAllocation();
+  return tracked(__libc_memalign(alignment, size));
+}
+
+void free(void *p) noexcept
+{
+  untrack(p);
+  __libc_free(p);
+}
+}
+#else
+// Elsewhere only allocations through operator new are seen
+void *operator new(size_t size)
+{
+  countAllocation();
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+#endif
+
+struct Measurement
+{
+  double milliseconds{0.0};
+  size_t allocations{0};
+  int64_t retainedBytes{0}; // live heap growth, 0 where it isn't tracked
+};
+
+template <typename F>
+static Measurement measure(F &&f)
+{
+  g_numAllocations = 0;
+  const int64_t liveBefore = g_liveBytes.load();
+  g_countAllocations = true;
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  const auto end = std::chrono::steady_clock::now();
+  g_countAllocations = false;
+  return {std::chrono::duration<double, std::milli>(end - start).count(),
+      g_numAllocations.load(),
+      g_liveBytes.load() - liveBefore};
+}
+
+// ANARI helpers //////////////////////////////////////////////////////////////
+
+static bool g_verbose = false;
+
+static void statusFunc(const void * /*userData*/,
+    ANARIDevice /*device*/,
+    ANARIObject /*source*/,
+    ANARIDataType /*sourceType*/,
+    ANARIStatusSeverity severity,
+    ANARIStatusCode /*code*/,
+    const char *message)
+{
+  if (severity <= ANARI_SEVERITY_WARNING)
+    std::fprintf(stderr, "[anari] %s\n", message);
+  else if (g_verbose)
+    std::fprintf(stderr, "[anari debug] %s\n", message);
+}
+
+// Managed array filled from 'data', which can be released right away
+static ANARIArray1D newArray1D(ANARIDevice d,
+    ANARIDataType type,
+    size_t elementSize,
+    const void *data,
+    size_t count)
+{
+  ANARIArray1D array =
+      anariNewArray1D(d, nullptr, nullptr, nullptr, type, count);
+  std::memcpy(anariMapArray(d, array), data, elementSize * count);
+  anariUnmapArray(d, array);
+  return array;
+}
+
+static ANARIArray1D newObjectArray(ANARIDevice d,
+    ANARIDataType type,
+    const ANARIObject *objects,
+    size_t count = 1)
+{
+  return newArray1D(d, type, sizeof(ANARIObject), objects, count);
+}
+
+static ANARIArray1D newObjectArray(
+    ANARIDevice d, ANARIDataType type, ANARIObject object)
+{
+  return newObjectArray(d, type, &object);
+}
+
+static void setAndRelease(ANARIDevice d,
+    ANARIObject o,
+    const char *name,
+    ANARIDataType type,
+    ANARIObject value)
+{
+  anariSetParameter(d, o, name, type, &value);
+  anariRelease(d, value);
+}
+
+static void setFloat3(
+    ANARIDevice d, ANARIObject o, const char *name, float x, float y, float z)
+{
+  const float v[3] = {x, y, z};
+  anariSetParameter(d, o, name, ANARI_FLOAT32_VEC3, v);
+}
+
+// Column-major transform placing instance 'i' of 'count' on a grid
+static void gridTransform(size_t i, size_t count, float offset, float *m)
+{
+  const size_t side = size_t(std::ceil(std::sqrt(double(count))));
+  const float spacing = 2.f / float(side);
+  std::fill_n(m, 16, 0.f);
+  m[0] = m[5] = m[10] = 0.5f * spacing;
+  m[12] = -1.f + spacing * (float(i % side) + 0.5f) + offset;
+  m[13] = -1.f + spacing * (float(i / side) + 0.5f);
+  m[15] = 1.f;
+}
+
+// A frame looking down -z at [-1, 1]^2, lit by one directional light,
+// rendering one sample per anariRenderFrame() call
+struct Scene
+{
+  ANARIDevice device{nullptr};
+  ANARIWorld world{nullptr};
+  ANARIFrame frame{nullptr};
+
+  explicit Scene(ANARIDevice d, uint32_t width = 32, uint32_t height = 32)
+      : device(d)
+  {
+    world = anariNewWorld(d);
+
+    ANARILight light = anariNewLight(d, "directional");
+    setFloat3(d, light, "direction", 0.f, 0.f, -1.f);
+    anariCommitParameters(d, light);
+    setAndRelease(d,
+        world,
+        "light",
+        ANARI_ARRAY1D,
+        newObjectArray(d, ANARI_LIGHT, light));
+    anariRelease(d, light);
+
+    ANARICamera camera = anariNewCamera(d, "perspective");
+    setFloat3(d, camera, "position", 0.f, 0.f, 3.f);
+    setFloat3(d, camera, "direction", 0.f, 0.f, -1.f);
+    const float aspect = float(width) / float(height);
+    anariSetParameter(d, camera, "aspect", ANARI_FLOAT32, &aspect);
+    anariCommitParameters(d, camera);
+
+    ANARIRenderer renderer = anariNewRenderer(d, "default");
+    const bool runAsync = false;
+    anariSetParameter(d, renderer, "runAsync", ANARI_BOOL, &runAsync);
+    anariCommitParameters(d, renderer);
+
+    frame = anariNewFrame(d);
+    const uint32_t size[2] = {width, height};
+    const ANARIDataType colorType = ANARI_FLOAT32_VEC4;
+    anariSetParameter(d, frame, "size", ANARI_UINT32_VEC2, size);
+    anariSetParameter(d, frame, "channel.color", ANARI_DATA_TYPE, &colorType);
+    anariSetParameter(d, frame, "world", ANARI_WORLD, &world);
+    setAndRelease(d, frame, "camera", ANARI_CAMERA, camera);
+    setAndRelease(d, frame, "renderer", ANARI_RENDERER, renderer);
+    anariCommitParameters(d, frame);
+  }
+
+  ~Scene()
+  {
+    anariRelease(device, frame);
+    anariRelease(device, world);
+  }
+
+  void setInstances(const ANARIInstance *instances, size_t count = 1)
+  {
+    setAndRelease(device,
+        world,
+        "instance",
+        ANARI_ARRAY1D,
+        newObjectArray(
+            device, ANARI_INSTANCE, (const ANARIObject *)instances, count));
+    anariCommitParameters(device, world);
+  }
+
+  void setLight(ANARILight light)
+  {
+    setAndRelease(device,
+        world,
+        "light",
+        ANARI_ARRAY1D,
+        newObjectArray(device, ANARI_LIGHT, light));
+    anariCommitParameters(device, world);
+  }
+
+  void render()
+  {
+    anariRenderFrame(device, frame);
+    anariFrameReady(device, frame, ANARI_WAIT);
+  }
+
+  // RGBA floats of the accumulated image
+  std::vector<float> color()
+  {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    ANARIDataType type = ANARI_UNKNOWN;
+    const auto *pixels = (const float *)anariMapFrame(
+        device, frame, "channel.color", &width, &height, &type);
+    std::vector<float> result(pixels, pixels + 4 * size_t(width) * height);
+    anariUnmapFrame(device, frame, "channel.color");
+    return result;
+  }
+};
+
+// A group holding one matte surface of 'geometry', taking its reference
+static ANARIGroup newSurfaceGroup(ANARIDevice d, ANARIGeometry geometry)
+{
+  anariCommitParameters(d, geometry);
+
+  ANARIMaterial material = anariNewMaterial(d, "matte");
+  anariCommitParameters(d, material);
+
+  ANARISurface surface = anariNewSurface(d);
+  setAndRelease(d, surface, "geometry", ANARI_GEOMETRY, geometry);
+  setAndRelease(d, surface, "material", ANARI_MATERIAL, material);
+  anariCommitParameters(d, surface);
+
+  ANARIGroup group = anariNewGroup(d);
+  setAndRelease(d,
+      group,
+      "surface",
+      ANARI_ARRAY1D,
+      newObjectArray(d, ANARI_SURFACE, surface));
+  anariRelease(d, surface);
+  anariCommitParameters(d, group);
+  return group;
+}
+
+// One small triangle
+static ANARIGroup newTriangleGroup(ANARIDevice d)
+{
+  const float vertices[9] = {-1.f, -1.f, 0.f, 1.f, -1.f, 0.f, 0.f, 1.f, 0.f};
+  ANARIGeometry geometry = anariNewGeometry(d, "triangle");
+  setAndRelease(d,
+      geometry,
+      "vertex.position",
+      ANARI_ARRAY1D,
+      newArray1D(d, ANARI_FLOAT32_VEC3, 3 * sizeof(float), vertices, 3));
+  return newSurfaceGroup(d, geometry);
+}
+
+static void printMeasurement(const char *label, const Measurement &m, size_t n)
+{
+  std::printf("  %-14s %10.2f ms %12zu allocs (%.4f per instance)\n",
+      label,
+      m.milliseconds,
+      m.allocations,
+      double(m.allocations) / double(std::max<size_t>(n, 1)));
+}
+
+// Benchmark modes ////////////////////////////////////////////////////////////
+
+static std::vector<size_t> parseCounts(
+    int argc, char **argv, std::vector<size_t> defaults)
+{
+  if (argc == 0)
+    return defaults;
+  std::vector<size_t> counts;
+  for (int i = 0; i < argc; i++)
+    counts.push_back(std::strtoull(argv[i], nullptr, 10));
+  return counts;
+}
+
+// Instance expansion: the first frame creates and fills every Cycles object,
+// the second rewrites the transforms of the same array in place
+static void benchInstances(ANARIDevice d, int argc, char **argv)
+{
+  const auto counts = parseCounts(argc,
+      argv,
+      {1000, 10000, 100000, 1000000, 10000000});
+
+  ANARIGroup group = newTriangleGroup(d);
+
+  for (size_t n : counts) {
+    Scene scene(d);
+
+    std::vector<float> xfms(16 * n);
+    for (size_t i = 0; i < n; i++)
+      gridTransform(i, n, 0.f, &xfms[16 * i]);
+    ANARIArray1D xfmArray = newArray1D(
+        d, ANARI_FLOAT32_MAT4, 16 * sizeof(float), xfms.data(), n);
+    std::vector<float>().swap(xfms);
+
+    ANARIInstance instance = anariNewInstance(d, "transform");
+    anariSetParameter(d, instance, "group", ANARI_GROUP, &group);
+    anariSetParameter(d, instance, "transform", ANARI_ARRAY1D, &xfmArray);
+    anariCommitParameters(d, instance);
+    scene.setInstances(&instance);
+
+    const auto first = measure([&]() { scene.render(); });
+
+    const auto update = measure([&]() {
+      auto *m = (float *)anariMapArray(d, xfmArray);
+      for (size_t i = 0; i < n; i++)
+        gridTransform(i, n, 0.01f, m + 16 * i);
+      anariUnmapArray(d, xfmArray);
+      scene.render();
+    });
+
+    std::printf("instances %zu\n", n);
+    printMeasurement("first frame", first, n);
+    printMeasurement("update frame", update, n);
+
+    anariRelease(d, instance);
+    anariRelease(d, xfmArray);
+  }
+
+  anariRelease(d, group);
+}
+
+// Transform-only edits: every instance recommits its 'transform' each frame,
+// which the device applies to the existing Cycles objects without resyncing
+// the world
+static void benchAnimate(ANARIDevice d, int argc, char **argv)
+{
+  const size_t n = argc > 0 ? std::strtoull(argv[0], nullptr, 10) : 10000;
+  const size_t frames = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100;
+
+  ANARIGroup group = newTriangleGroup(d);
+  Scene scene(d);
+
+  std::vector<ANARIInstance> instances(n);
+  float xfm[16];
+  for (size_t i = 0; i < n; i++) {
+    instances[i] = anariNewInstance(d, "transform");
+    anariSetParameter(d, instances[i], "group", ANARI_GROUP, &group);
+    gridTransform(i, n, 0.f, xfm);
+    anariSetParameter(d, instances[i], "transform", ANARI_FLOAT32_MAT4, xfm);
+    anariCommitParameters(d, instances[i]);
+  }
+  scene.setInstances(instances.data(), n);
+  scene.render();
+
+  double total = 0.0;
+  double worst = 0.0;
+  size_t allocations = 0;
+  for (size_t f = 0; f < frames; f++) {
+    const float offset = 0.1f * std::sin(0.1f * float(f + 1));
+    const auto m = measure([&]() {
+      for (size_t i = 0; i < n; i++) {
+        gridTransform(i, n, offset, xfm);
+        anariSetParameter(
+            d, instances[i], "transform", ANARI_FLOAT32_MAT4, xfm);
+        anariCommitParameters(d, instances[i]);
+      }
+      scene.render();
+    });
+    total += m.milliseconds;
+    worst = std::max(worst, m.milliseconds);
+    allocations += m.allocations;
+  }
+
+  const size_t numFrames = std::max<size_t>(frames, 1);
+  std::printf("animate %zu instances, %zu frames\n", n, frames);
+  std::printf("  %-14s %10.2f ms mean %10.2f ms worst\n",
+      "frame latency",
+      total / double(numFrames),
+      worst);
+  std::printf("  %-14s %10.1f allocs (%.4f per instance)\n",
+      "per frame",
+      double(allocations) / double(numFrames),
+      double(allocations) / double(numFrames) / double(std::max<size_t>(n, 1)));
+
+  for (auto instance : instances)
+    anariRelease(d, instance);
+  anariRelease(d, group);
+}
+
+// One sphere at the origin
+static ANARIGroup newSphereGroup(ANARIDevice d, float radius)
+{
+  const float center[3] = {0.f, 0.f, 0.f};
+  ANARIGeometry geometry = anariNewGeometry(d, "sphere");
+  setAndRelease(d,
+      geometry,
+      "vertex.position",
+      ANARI_ARRAY1D,
+      newArray1D(d, ANARI_FLOAT32_VEC3, 3 * sizeof(float), center, 1));
+  anariSetParameter(d, geometry, "radius", ANARI_FLOAT32, &radius);
+  return newSurfaceGroup(d, geometry);
+}
+
+// Equirectangular sky with a small, very bright sun, which is where
+// importance sampling quality decides the noise level
+static std::vector<float> sunSky(uint32_t width, uint32_t height)
+{
+  const float pi = 3.14159265f;
+  const float sunTheta = 0.3f * pi;
+  const float sunPhi = 0.6f * pi;
+  const float sunSize = 0.02f;
+
+  std::vector<float> texels(3 * size_t(width) * height);
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t x = 0; x < width; x++) {
+      const float theta = pi * (float(y) + 0.5f) / float(height);
+      const float phi = 2.f * pi * (float(x) + 0.5f) / float(width);
+      const float cosAngle = std::sin(theta) * std::sin(sunTheta)
+              * std::cos(phi - sunPhi)
+          + std::cos(theta) * std::cos(sunTheta);
+      const bool sun = std::acos(std::clamp(cosAngle, -1.f, 1.f)) < sunSize;
+      float *t = &texels[3 * (size_t(y) * width + x)];
+      t[0] = sun ? 5000.f : 0.2f;
+      t[1] = sun ? 4800.f : 0.3f;
+      t[2] = sun ? 4500.f : 0.5f;
+    }
+  }
+  return texels;
+}
+
+// One instance parameter array of an encoded transform list
+struct EncodedArray
+{
+  const char *param;
+  ANARIDataType type;
+  size_t floatsPerElement;
+  std::vector<float> data;
+};
+
+// The grid transforms of gridTransform() in the encoding 'format'. Every
+// encoding holds a translation and uniform scale, so all place the same grid,
+// except 'translation' which keeps the triangles at unit scale.
+static std::vector<EncodedArray> encodeTransforms(
+    const std::string &format, size_t n, float offset)
+{
+  auto encode = [&](const char *param,
+                    ANARIDataType type,
+                    size_t floats,
+                    auto &&write) {
+    EncodedArray a{param, type, floats, std::vector<float>(floats * n)};
+    float m[16];
+    for (size_t i = 0; i < n; i++) {
+      gridTransform(i, n, offset, m);
+      write(m, &a.data[floats * i]);
+    }
+    return a;
+  };
+
+  if (format == "mat4") {
+    auto write = [](const float *m, float *d) { std::copy_n(m, 16, d); };
+    return {encode("transform", ANARI_FLOAT32_MAT4, 16, write)};
+  } else if (format == "mat3x4") {
+    auto write = [](const float *m, float *d) {
+      for (int c = 0; c < 4; c++)
+        std::copy_n(m + 4 * c, 3, d + 3 * c);
+    };
+    return {encode("transform", ANARI_FLOAT32_MAT3x4, 12, write)};
+  } else if (format == "translation") {
+    auto write = [](const float *m, float *d) { std::copy_n(m + 12, 3, d); };
+    return {encode("transform", ANARI_FLOAT32_VEC3, 3, write)};
+  } else if (format == "translation+scale") {
+    auto write = [](const float *m, float *d) {
+      std::copy_n(m + 12, 3, d);
+      d[3] = m[0];
+    };
+    return {encode("transform", ANARI_FLOAT32_VEC4, 4, write)};
+  }
+
+  auto rotation = [](const float *, float *d) {
+    d[0] = d[1] = d[2] = 0.f;
+    d[3] = 1.f;
+  };
+  auto translation = [](const float *m, float *d) {
+    std::copy_n(m + 12, 3, d);
+  };
+  auto scale = [](const float *m, float *d) { d[0] = m[0]; };
+  return {encode("transform.rotation", ANARI_FLOAT32_QUAT_IJKW, 4, rotation),
+      encode("transform.translation", ANARI_FLOAT32_VEC3, 3, translation),
+      encode("transform.scale", ANARI_FLOAT32, 1, scale)};
+}
+
+// Compact transform encodings: the memory each needs, the time from handing
+// the arrays to the device to the first frame, and an in-place update
+static void benchFormats(ANARIDevice d, int argc, char **argv)
+{
+  const size_t n = argc > 0 ? std::strtoull(argv[0], nullptr, 10) : 1000000;
+  ANARIGroup group = newTriangleGroup(d);
+
+  std::printf("formats %zu transforms\n", n);
+  for (const char *format :
+      {"mat4", "mat3x4", "translation", "translation+scale", "trs"}) {
+    const auto encoded = encodeTransforms(format, n, 0.f);
+    const auto moved = encodeTransforms(format, n, 0.01f);
+
+    size_t bytes = 0;
+    for (const auto &a : encoded)
+      bytes += a.data.size() * sizeof(float);
+
+    Scene scene(d);
+    ANARIInstance instance = anariNewInstance(d, "transform");
+    anariSetParameter(d, instance, "group", ANARI_GROUP, &group);
+    std::vector<ANARIArray1D> arrays;
+
+    const auto ingest = measure([&]() {
+      for (const auto &a : encoded) {
+        arrays.push_back(newArray1D(d,
+            a.type,
+            a.floatsPerElement * sizeof(float),
+            a.data.data(),
+            n));
+        anariSetParameter(d, instance, a.param, ANARI_ARRAY1D, &arrays.back());
+      }
+      anariCommitParameters(d, instance);
+      scene.setInstances(&instance);
+      scene.render();
+    });
+
+    const auto update = measure([&]() {
+      for (size_t i = 0; i < arrays.size(); i++) {
+        std::memcpy(anariMapArray(d, arrays[i]),
+            moved[i].data.data(),
+            moved[i].data.size() * sizeof(float));
+        anariUnmapArray(d, arrays[i]);
+      }
+      scene.render();
+    });
+
+    std::printf("  %-18s %8.1f MB (%5.1f%% of mat4)\n",
+        format,
+        double(bytes) / (1024.0 * 1024.0),
+        100.0 * double(bytes) / double(std::max<size_t>(64 * n, 1)));
+    printMeasurement("ingest", ingest, n);
+    printMeasurement("update frame", update, n);
+
+    for (auto array : arrays)
+      anariRelease(d, array);
+    anariRelease(d, instance);
+  }
+
+  anariRelease(d, group);
+}
+
+// Native curves: the same tubes given as cylinders and as triangle meshes
+// with per-vertex normals, the way applications tessellate them today
+static void benchCurves(ANARIDevice d, int argc, char **argv)
+{
+  const size_t n = argc > 0 ? std::strtoull(argv[0], nullptr, 10) : 100000;
+  const size_t sides = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16;
+  const size_t numFrames = 16;
+
+  // Short tubes along x on a grid covering the view
+  const size_t side = size_t(std::ceil(std::sqrt(double(n))));
+  const float spacing = 2.f / float(side);
+  const float radius = 0.1f * spacing;
+  auto endpoint = [&](size_t i, int end, float *p) {
+    p[0] = -1.f + spacing * (float(i % side) + (end ? 0.9f : 0.1f));
+    p[1] = -1.f + spacing * (float(i / side) + 0.5f);
+    p[2] = 0.f;
+  };
+
+  std::vector<float> cylinderVertices(6 * n);
+  for (size_t i = 0; i < n; i++) {
+    endpoint(i, 0, &cylinderVertices[6 * i]);
+    endpoint(i, 1, &cylinderVertices[6 * i + 3]);
+  }
+
+  const float pi = 3.14159265f;
+  const size_t vertsPerTube = 2 * sides;
+  std::vector<float> meshVertices(3 * vertsPerTube * n);
+  std::vector<float> meshNormals(3 * vertsPerTube * n);
+  std::vector<uint32_t> meshIndices(6 * sides * n);
+  for (size_t i = 0; i < n; i++) {
+    for (size_t ring = 0; ring < 2; ring++) {
+      float p[3];
+      endpoint(i, int(ring), p);
+      for (size_t k = 0; k < sides; k++) {
+        const float angle = 2.f * pi * float(k) / float(sides);
+        const size_t v = 3 * (i * vertsPerTube + ring * sides + k);
+        meshNormals[v] = 0.f;
+        meshNormals[v + 1] = std::cos(angle);
+        meshNormals[v + 2] = std::sin(angle);
+        for (int c = 0; c < 3; c++)
+          meshVertices[v + c] = p[c] + radius * meshNormals[v + c];
+      }
+    }
+    for (size_t k = 0; k < sides; k++) {
+      const auto base = uint32_t(i * vertsPerTube);
+      const uint32_t a = base + uint32_t(k);
+      const uint32_t b = base + uint32_t((k + 1) % sides);
+      const uint32_t c = b + uint32_t(sides);
+      const uint32_t e = a + uint32_t(sides);
+      const uint32_t quad[6] = {a, b, c, a, c, e};
+      std::copy_n(quad, 6, &meshIndices[6 * (i * sides + k)]);
+    }
+  }
+
+  auto run = [&](const char *label, ANARIGeometry geometry, size_t bytes) {
+    ANARIGroup group = newSurfaceGroup(d, geometry);
+    Scene scene(d, 256, 256);
+    ANARIInstance instance = anariNewInstance(d, "transform");
+    anariSetParameter(d, instance, "group", ANARI_GROUP, &group);
+    anariCommitParameters(d, instance);
+    scene.setInstances(&instance);
+    anariRelease(d, instance);
+
+    const auto first = measure([&]() { scene.render(); });
+    const auto frames = measure([&]() {
+      for (size_t f = 0; f < numFrames; f++)
+        scene.render();
+    });
+
+    // The input arrays were copied to the device before the first frame,
+    // which then adds the converted Cycles data and the BVH
+    std::printf("  %-14s %8.1f MB input %8.1f MB kept by the first frame\n",
+        label,
+        double(bytes) / (1024.0 * 1024.0),
+        double(first.retainedBytes) / (1024.0 * 1024.0));
+    printMeasurement("first frame", first, n);
+    std::printf("  %-14s %10.2f ms per sample\n",
+        "render",
+        frames.milliseconds / double(numFrames));
+    anariRelease(d, group);
+  };
+
+  std::printf("curves %zu tubes, tessellated with %zu sides\n", n, sides);
+
+  ANARIGeometry cylinders = anariNewGeometry(d, "cylinder");
+  setAndRelease(d,
+      cylinders,
+      "vertex.position",
+      ANARI_ARRAY1D,
+      newArray1D(d,
+          ANARI_FLOAT32_VEC3,
+          3 * sizeof(float),
+          cylinderVertices.data(),
+          2 * n));
+  anariSetParameter(d, cylinders, "radius", ANARI_FLOAT32, &radius);
+  run("cylinder", cylinders, cylinderVertices.size() * sizeof(float));
+
+  ANARIGeometry mesh = anariNewGeometry(d, "triangle");
+  setAndRelease(d,
+      mesh,
+      "vertex.position",
+      ANARI_ARRAY1D,
+      newArray1D(d,
+          ANARI_FLOAT32_VEC3,
+          3 * sizeof(float),
+          meshVertices.data(),
+          vertsPerTube * n));
+  setAndRelease(d,
+      mesh,
+      "vertex.normal",
+      ANARI_ARRAY1D,
+      newArray1D(d,
+          ANARI_FLOAT32_VEC3,
+          3 * sizeof(float),
+          meshNormals.data(),
+          vertsPerTube * n));
+  setAndRelease(d,
+      mesh,
+      "primitive.index",
+      ANARI_ARRAY1D,
+      newArray1D(d,
+          ANARI_UINT32_VEC3,
+          3 * sizeof(uint32_t),
+          meshIndices.data(),
+          2 * sides * n));
+  run("tessellated",
+      mesh,
+      (meshVertices.size() + meshNormals.size()) * sizeof(float)
+          + meshIndices.size() * sizeof(uint32_t));
+}
+
+// Importance map resolution: every resolution renders the same number of
+// samples, compared against a long render using the automatic resolution
+static void benchHdri(ANARIDevice d, int argc, char **argv)
+{
+  const size_t samples = argc > 0 ? std::strtoull(argv[0], nullptr, 10) : 16;
+  auto resolutions = parseCounts(std::max(argc - 1, 0),
+      argv + std::min(argc, 1),
+      {0, 64, 128, 256, 512, 1024, 2048});
+
+  const uint32_t width = 2048;
+  const uint32_t height = 1024;
+  const auto sky = sunSky(width, height);
+
+  ANARIGroup group = newSphereGroup(d, 0.8f);
+
+  auto renderWith = [&](int mapResolution, size_t numSamples, double &ms) {
+    Scene scene(d, 64, 64);
+
+    ANARIArray2D radiance = anariNewArray2D(
+        d, nullptr, nullptr, nullptr, ANARI_FLOAT32_VEC3, width, height);
+    std::memcpy(anariMapArray(d, radiance),
+        sky.data(),
+        sky.size() * sizeof(float));
+    anariUnmapArray(d, radiance);
+
+    ANARILight light = anariNewLight(d, "hdri");
+    setAndRelease(d, light, "radiance", ANARI_ARRAY2D, radiance);
+    // Hidden from camera rays, so the error only measures the lit sphere
+    const bool visible = false;
+    anariSetParameter(d, light, "visible", ANARI_BOOL, &visible);
+    anariSetParameter(d, light, "mapResolution", ANARI_INT32, &mapResolution);
+    anariCommitParameters(d, light);
+    scene.setLight(light);
+    anariRelease(d, light);
+
+    ANARIInstance instance = anariNewInstance(d, "transform");
+    anariSetParameter(d, instance, "group", ANARI_GROUP, &group);
+    anariCommitParameters(d, instance);
+    scene.setInstances(&instance);
+    anariRelease(d, instance);
+
+    // The first frame includes building the sampling tables
+    ms = measure([&]() { scene.render(); }).milliseconds;
+    for (size_t i = 1; i < numSamples; i++)
+      scene.render();
+    return scene.color();
+  };
+
+  double referenceMs = 0.0;
+  const auto reference = renderWith(0, 64 * samples, referenceMs);
+
+  std::printf(
+      "hdri %zu samples, reference %zu samples\n", samples, 64 * samples);
+  for (size_t r : resolutions) {
+    double firstMs = 0.0;
+    const auto image = renderWith(int(r), samples, firstMs);
+
+    double sumSquares = 0.0;
+    size_t numValues = 0;
+    for (size_t i = 0; i < image.size(); i++) {
+      if (i % 4 == 3)
+        continue;
+      const double diff = double(image[i]) - double(reference[i]);
+      sumSquares += diff * diff;
+      numValues++;
+    }
+    const double rmse =
+        std::sqrt(sumSquares / double(std::max<size_t>(numValues, 1)));
+
+    std::printf(
+        "  map %-6zu rmse %10.5f   first frame %10.2f ms\n", r, rmse, firstMs);
+  }
+
+  anariRelease(d, group);
+}
+
+// Entry point ////////////////////////////////////////////////////////////////
+
+struct Mode
+{
+  const char *name;
+  void (*run)(ANARIDevice d, int argc, char **argv);
+};
+
+static const Mode g_modes[] = {{"instances", benchInstances},
+    {"animate", benchAnimate},
+    {"formats", benchFormats},
+    {"curves", benchCurves},
+    {"hdri", benchHdri}};
+
+int main(int argc, char **argv)
+{
+  int arg = 1;
+  if (arg < argc && std::strcmp(argv[arg], "--verbose") == 0) {
+    g_verbose = true;
+    arg++;
+  }
+
+  const Mode *mode = nullptr;
+  if (arg < argc) {
+    for (const auto &m : g_modes) {
+      if (std::strcmp(argv[arg], m.name) == 0)
+        mode = &m;
+    }
+  }
+
+  if (!mode) {
+    std::fprintf(
+        stderr, "usage: %s [--verbose] <mode> [args...]\nmodes:", argv[0]);
+    for (const auto &m : g_modes)
+      std::fprintf(stderr, " %s", m.name);
+    std::fprintf(stderr, "\n");
+    return 1;
+  }
+
+  ANARILibrary library = anariLoadLibrary("cycles", statusFunc, nullptr);
+  if (!library) {
+    std::fprintf(stderr, "failed to load the cycles ANARI library\n");
+    return 1;
+  }
+  ANARIDevice device = anariNewDevice(library, "default");
+  anariCommitParameters(device, device);
+
+  mode->run(device, argc - arg - 1, argv + arg + 1);
+
+  anariRelease(device, device);
+  anariUnloadLibrary(library);
+  return 0;
+}
@@ -3,6 +3,11 @@
 
 #include "CyclesGlobalState.h"
 #include "Frame.h"
+// cycles
+#include "scene/geometry.h"
+#include "scene/object.h"
+#include "scene/scene.h"
+#include "scene/shader.h"
 
 namespace anari_cycles {
 
@@ -15,4 +20,38 @@ void CyclesGlobalState::waitOnCurrentFrame() const
   output_driver->wait();
 }
 
+void CyclesGlobalState::deleteNodeDeferred(ccl::Object *node)
+{
+  if (node)
+    pendingDeletions.objects.insert(node);
+}
+
+void CyclesGlobalState::deleteNodeDeferred(ccl::Geometry *node)
+{
+  if (node)
+    pendingDeletions.geometry.insert(node);
+}
+
+void CyclesGlobalState::deleteNodeDeferred(ccl::Shader *node)
+{
+  if (node)
+    pendingDeletions.shaders.insert(node);
+}
+
+void CyclesGlobalState::flushPendingDeletions()
+{
+  // Objects reference geometry, which references shaders, so delete them in
+  // that order
+  auto &pending = pendingDeletions;
+  if (!pending.objects.empty())
+    scene->delete_nodes(pending.objects);
+  if (!pending.geometry.empty())
+    scene->delete_nodes(pending.geometry);
+  if (!pending.shaders.empty())
+    scene->delete_nodes(pending.shaders);
+  pending.objects.clear();
+  pending.geometry.clear();
+  pending.shaders.clear();
+}
+
 } // namespace anari_cycles
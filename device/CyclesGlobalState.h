@@ -9,20 +9,28 @@
 // cycles
 #include "scene/shader_nodes.h"
 #include "session/session.h"
+#include "util/set.h"
 // std
 #include <atomic>
 
 namespace ccl {
 struct BackgroundNode;
+class Geometry;
+class Object;
+class Shader;
 } // namespace ccl
 
 namespace anari_cycles {
 
+struct World;
+
 struct CyclesGlobalState : public helium::BaseGlobalDeviceState
 {
   struct ObjectUpdates
   {
     helium::TimeStamp lastSceneChange{0};
+    // Light orientation changes only need light object transforms updated
+    helium::TimeStamp lastLightTransformChange{0};
     helium::TimeStamp lastAccumulationReset{0};
   } objectUpdates;
 
@@ -36,6 +44,18 @@ struct CyclesGlobalState : public helium::BaseGlobalDeviceState
 
   FrameOutputDriver *output_driver{nullptr};
 
+  // World whose objects are currently placed in the Cycles scene
+  World *currentWorld{nullptr};
+
+  // Nodes released by ANARI objects, deleted in one batch at the next sync
+  // point as every single delete_node() searches the whole scene
+  struct PendingDeletions
+  {
+    ccl::set<ccl::Object *> objects;
+    ccl::set<ccl::Geometry *> geometry;
+    ccl::set<ccl::Shader *> shaders;
+  } pendingDeletions;
+
   ccl::ColorNode *backgroundColor{nullptr};
   ccl::ColorNode *ambientColor{nullptr};
   ccl::ValueNode *ambientIntensity{nullptr};
@@ -44,6 +64,11 @@ struct CyclesGlobalState : public helium::BaseGlobalDeviceState
 
   CyclesGlobalState(ANARIDevice d);
   void waitOnCurrentFrame() const;
+
+  void deleteNodeDeferred(ccl::Object *node);
+  void deleteNodeDeferred(ccl::Geometry *node);
+  void deleteNodeDeferred(ccl::Shader *node);
+  void flushPendingDeletions();
 };
 
 #define CYCLES_ANARI_TYPEFOR_SPECIALIZATION(type, anari_type)                  \
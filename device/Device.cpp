@@ -326,6 +326,9 @@ void CyclesDevice::initDevice()
       "Using Cycles Device '%s'",
       ccl::Device::string_from_type(state.session_params.device.type).c_str());
 
+  // Dynamic BVHs let geometry with unchanged topology be refit
+  state.scene_params.bvh_type = ccl::BVH_TYPE_DYNAMIC;
+
   state.session =
       std::make_unique<ccl::Session>(state.session_params, state.scene_params);
   state.scene = state.session->scene.get();
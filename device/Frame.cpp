@@ -99,12 +99,20 @@ void Frame::renderFrame()
     return;
   }
 
-  if (m_worldLastChanged < state.objectUpdates.lastSceneChange) {
+  if (m_worldLastChanged < state.objectUpdates.lastSceneChange
+      || state.currentWorld != m_world.ptr) {
     reportMessage(ANARI_SEVERITY_DEBUG, "frame -- updating world");
     m_world->setCyclesWorldObjects();
     m_worldLastChanged = helium::newTimeStamp();
+  } else if (m_worldLastChanged
+      < state.objectUpdates.lastLightTransformChange) {
+    reportMessage(ANARI_SEVERITY_DEBUG, "frame -- updating light transforms");
+    m_world->updateCyclesLightTransforms();
+    m_worldLastChanged = helium::newTimeStamp();
   }
 
+  state.flushPendingDeletions();
+
   if (currentFrameChanged || resetAccumulationNextFrame()) {
     reportMessage(ANARI_SEVERITY_DEBUG, "frame -- resetting accumulation");
 
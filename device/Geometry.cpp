@@ -2,28 +2,110 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "Geometry.h"
+#include "Material.h"
+#include "SpatialField.h"
+#include "array_conversion.h"
+#include "isosurface.h"
+#include "spatial_sort.h"
 // cycles
+#include "scene/hair.h"
 #include "scene/mesh.h"
 #include "scene/pointcloud.h"
+// tbb
+#include <tbb/parallel_reduce.h>
+// std
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
 
 namespace anari_cycles {
 
 // Helper types/functions /////////////////////////////////////////////////////
 
-template <int T>
-struct convert_toFloat4
+// Adds 'name' using the narrowest float type that holds every component of
+// 'array' and fills it from the array, scalars stay a single float instead
+// of being widened to a float4
+static Attribute *addConvertedAttribute(ccl::AttributeSet &attributes,
+    ustring name,
+    AttributeElement element,
+    const Array1D *array,
+    size_t count,
+    const uint32_t *gather = nullptr)
 {
-  using base_type = typename anari::ANARITypeProperties<T>::base_type;
-  const int nc = anari::ANARITypeProperties<T>::components;
-  anari_vec::float4 operator()(const void *src, size_t offset)
-  {
-    anari_vec::float4 retval = {0.f, 0.f, 0.f, 1.f};
-    if constexpr (!anari::isObject(T) && T != ANARI_UNKNOWN)
-      anari::ANARITypeProperties<T>::toFloat4(
-          &retval[0], (const base_type *)src + nc * offset);
-    return retval;
+  Attribute *attr = nullptr;
+  switch (anari::componentsOf(array->elementType())) {
+  case 1:
+    attr = attributes.add(name, ccl::TypeFloat, element);
+    convertArray(array, attr->data_float(), count, gather);
+    break;
+  case 2:
+    attr = attributes.add(name, ccl::TypeFloat2, element);
+    convertArray(array, attr->data_float2(), count, gather);
+    break;
+  case 3:
+    attr = attributes.add(name, ccl::TypeColor, element);
+    convertArray(array, attr->data_float3(), count, gather);
+    break;
+  default:
+    attr = attributes.add(name, ccl::TypeFloat4, element);
+    convertArray(array, attr->data_float4(), count, gather);
+    break;
   }
-};
+  return attr;
+}
+
+// Vertices of the full geometry a node holds, null when it holds all of them
+static const uint32_t *vertexGather(const GeometrySyncState &state)
+{
+  return state.vertexGather.empty() ? nullptr : state.vertexGather.data();
+}
+
+// Same for primitives
+static const uint32_t *primitiveGather(const GeometrySyncState &state)
+{
+  return state.primitiveGather.empty() ? nullptr
+                                       : state.primitiveGather.data();
+}
+
+// One past the largest vertex 'corners' refer to, sizing dense per-vertex
+// lookup tables
+static size_t vertexTableSize(const std::vector<uint32_t> &corners)
+{
+  return tbb::parallel_reduce(
+      tbb::blocked_range<size_t>(0, corners.size(), CONVERSION_GRAIN_SIZE),
+      size_t(0),
+      [&](const tbb::blocked_range<size_t> &r, size_t n) {
+        for (size_t i = r.begin(); i < r.end(); i++)
+          n = std::max(n, size_t(corners[i]) + 1);
+        return n;
+      },
+      [](size_t a, size_t b) { return std::max(a, b); });
+}
+
+static void atomicMin(std::atomic<uint32_t> &a, uint32_t v)
+{
+  uint32_t current = a.load(std::memory_order_relaxed);
+  while (v < current
+      && !a.compare_exchange_weak(current, v, std::memory_order_relaxed)) {
+  }
+}
+
+// Adds sRGB byte colors given per corner using Cycles' 4-byte corner storage
+// directly, which the renderer decodes to linear itself
+static Attribute *addByteColorCorners(ccl::Mesh *mesh, const Array1D *array)
+{
+  Attribute *attr = mesh->attributes.add(
+      ustring("color"), ccl::TypeRGBA, ATTR_ELEMENT_CORNER_BYTE);
+  const size_t numCorners = mesh->num_triangles() * 3;
+  const auto *src = (const uchar4 *)array->data();
+  std::copy(
+      src, src + std::min(numCorners, array->size()), attr->data_uchar4());
+  return attr;
+}
 
 // Triangle definitions ///////////////////////////////////////////////////////
 
@@ -35,32 +117,95 @@ struct Triangle : public Geometry
   void commitParameters() override;
   void finalize() override;
 
+  bool canMergeIntoCyclesMesh() const override;
   ccl::Geometry *createCyclesGeometryNode() override;
-  void syncCyclesNode(ccl::Geometry *node) const override;
+  int syncCyclesNode(ccl::Geometry *node,
+      GeometrySyncState &state,
+      const GeometryChunk *chunk) const override;
 
   box3 bounds() const override;
 
+ protected:
+  size_t numPrimitives() const override;
+  void computePrimitiveCenters(float3 *centers) const override;
+  bool syncTopology(GeometrySyncState &state) const override;
+
  private:
-  void setVertexPosition(ccl::Mesh *mesh) const;
-  void setPrimitiveIndex(ccl::Mesh *mesh) const;
-  void setVertexNormal(ccl::Mesh *mesh) const;
-  void setVertexColor(ccl::Mesh *mesh) const;
-  void setVertexAttribute(ccl::Mesh *mesh,
-      const helium::IntrusivePtr<Array1D> &array,
-      const char *name) const;
+  size_t numNodeVertices(const GeometrySyncState &state) const;
+  void setVertexPosition(ccl::Mesh *mesh, const GeometrySyncState &state) const;
+  void setPrimitiveIndex(ccl::Mesh *mesh,
+      GeometrySyncState &state,
+      const GeometryChunk *chunk) const;
+  void setVertexNormal(ccl::Mesh *mesh, const GeometrySyncState &state) const;
+
+  // Inputs a Cycles attribute can be written from, the first one present
+  // wins: face-varying, then per-vertex, then per-primitive
+  struct AttributeInputs
+  {
+    const char *name{nullptr};
+    const Array1D *faceVarying{nullptr};
+    const Array1D *vertex{nullptr};
+    const Array1D *primitive{nullptr};
+  };
+
+  std::array<AttributeInputs, 5> attributeInputs() const;
+  void setAttribute(ccl::Mesh *mesh,
+      const GeometrySyncState &state,
+      const AttributeInputs &inputs) const;
+
+  // Optional cleanup of triangle soups before they reach Cycles: welds
+  // identical vertices, drops degenerate triangles and, if 'reorder' is set,
+  // sorts the triangles along a Morton curve
+  void preprocessTriangles(std::vector<uint32_t> &corners,
+      std::vector<uint32_t> &primitives,
+      GeometrySyncState &state,
+      bool reorder) const;
+  std::array<const Array1D *, 7> vertexArrays() const;
+  uint64_t hashVertex(uint32_t v) const;
+  bool sameVertex(uint32_t a, uint32_t b) const;
 
   helium::ChangeObserverPtr<Array1D> m_index;
   helium::ChangeObserverPtr<Array1D> m_vertexPosition;
-  helium::IntrusivePtr<Array1D> m_vertexNormal;
-  helium::IntrusivePtr<Array1D> m_vertexColor;
-  helium::IntrusivePtr<Array1D> m_vertexAttribute0;
-  helium::IntrusivePtr<Array1D> m_vertexAttribute1;
-  helium::IntrusivePtr<Array1D> m_vertexAttribute2;
-  helium::IntrusivePtr<Array1D> m_vertexAttribute3;
+  helium::ChangeObserverPtr<Array1D> m_vertexNormal;
+  helium::ChangeObserverPtr<Array1D> m_vertexColor;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute0;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute1;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute2;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute3;
+  helium::ChangeObserverPtr<Array1D> m_primitiveColor;
+  helium::ChangeObserverPtr<Array1D> m_primitiveAttribute0;
+  helium::ChangeObserverPtr<Array1D> m_primitiveAttribute1;
+  helium::ChangeObserverPtr<Array1D> m_primitiveAttribute2;
+  helium::ChangeObserverPtr<Array1D> m_primitiveAttribute3;
+  helium::ChangeObserverPtr<Array1D> m_faceVaryingColor;
+  helium::ChangeObserverPtr<Array1D> m_faceVaryingAttribute0;
+  helium::ChangeObserverPtr<Array1D> m_faceVaryingAttribute1;
+  helium::ChangeObserverPtr<Array1D> m_faceVaryingAttribute2;
+  helium::ChangeObserverPtr<Array1D> m_faceVaryingAttribute3;
+  bool m_preprocess{false};
+  helium::TimeStamp m_preprocessChanged{0};
 };
 
 Triangle::Triangle(CyclesGlobalState *s)
-    : Geometry(s), m_index(this), m_vertexPosition(this)
+    : Geometry(s),
+      m_index(this),
+      m_vertexPosition(this),
+      m_vertexNormal(this),
+      m_vertexColor(this),
+      m_vertexAttribute0(this),
+      m_vertexAttribute1(this),
+      m_vertexAttribute2(this),
+      m_vertexAttribute3(this),
+      m_primitiveColor(this),
+      m_primitiveAttribute0(this),
+      m_primitiveAttribute1(this),
+      m_primitiveAttribute2(this),
+      m_primitiveAttribute3(this),
+      m_faceVaryingColor(this),
+      m_faceVaryingAttribute0(this),
+      m_faceVaryingAttribute1(this),
+      m_faceVaryingAttribute2(this),
+      m_faceVaryingAttribute3(this)
 {}
 
 Triangle::~Triangle() = default;
@@ -77,6 +222,22 @@ void Triangle::commitParameters()
   m_vertexAttribute1 = getParamObject<Array1D>("vertex.attribute1");
   m_vertexAttribute2 = getParamObject<Array1D>("vertex.attribute2");
   m_vertexAttribute3 = getParamObject<Array1D>("vertex.attribute3");
+  m_primitiveColor = getParamObject<Array1D>("primitive.color");
+  m_primitiveAttribute0 = getParamObject<Array1D>("primitive.attribute0");
+  m_primitiveAttribute1 = getParamObject<Array1D>("primitive.attribute1");
+  m_primitiveAttribute2 = getParamObject<Array1D>("primitive.attribute2");
+  m_primitiveAttribute3 = getParamObject<Array1D>("primitive.attribute3");
+  m_faceVaryingColor = getParamObject<Array1D>("faceVarying.color");
+  m_faceVaryingAttribute0 = getParamObject<Array1D>("faceVarying.attribute0");
+  m_faceVaryingAttribute1 = getParamObject<Array1D>("faceVarying.attribute1");
+  m_faceVaryingAttribute2 = getParamObject<Array1D>("faceVarying.attribute2");
+  m_faceVaryingAttribute3 = getParamObject<Array1D>("faceVarying.attribute3");
+
+  const bool preprocess = getParam<bool>("preprocess", false);
+  if (preprocess != m_preprocess) {
+    m_preprocess = preprocess;
+    m_preprocessChanged = helium::newTimeStamp();
+  }
 }
 
 void Triangle::finalize()
@@ -84,33 +245,110 @@ void Triangle::finalize()
   if (!m_vertexPosition) {
     reportMessage(ANARI_SEVERITY_WARNING,
         "missing required parameter 'vertex.position' on triangle geometry");
+  } else {
+    warnShortVertexArrays("triangle",
+        m_vertexPosition->size(),
+        {{"vertex.normal", m_vertexNormal.get()},
+            {"vertex.color", m_vertexColor.get()},
+            {"vertex.attribute0", m_vertexAttribute0.get()},
+            {"vertex.attribute1", m_vertexAttribute1.get()},
+            {"vertex.attribute2", m_vertexAttribute2.get()},
+            {"vertex.attribute3", m_vertexAttribute3.get()}});
+  }
+
+  // Reads of these are gathered, so setAttribute() ignores short arrays
+  const size_t numTriangles = numPrimitives();
+  for (const auto &a : attributeInputs()) {
+    if (a.faceVarying && a.faceVarying->size() < numTriangles * 3) {
+      reportMessage(ANARI_SEVERITY_WARNING,
+          "ignoring 'faceVarying.%s' on triangle geometry, it has fewer "
+          "elements than the geometry has corners",
+          a.name);
+    }
+    if (a.primitive && a.primitive->size() < numTriangles) {
+      reportMessage(ANARI_SEVERITY_WARNING,
+          "ignoring 'primitive.%s' on triangle geometry, it has fewer "
+          "elements than the geometry has triangles",
+          a.name);
+    }
   }
 
   Geometry::finalize();
 }
 
+bool Triangle::canMergeIntoCyclesMesh() const
+{
+  return true;
+}
+
 ccl::Geometry *Triangle::createCyclesGeometryNode()
 {
   return deviceState()->scene->create_node<ccl::Mesh>();
 }
 
-void Triangle::syncCyclesNode(ccl::Geometry *node) const
+int Triangle::syncCyclesNode(ccl::Geometry *node,
+    GeometrySyncState &state,
+    const GeometryChunk *chunk) const
 {
   auto *mesh = (ccl::Mesh *)node;
 
   if (!m_vertexPosition) {
     reportMessage(ANARI_SEVERITY_WARNING,
         "Triangle::syncCyclesNode() detected incomplete geometry");
+    return GEOMETRY_UNCHANGED;
+  }
+
+  // Deforming meshes keep their index array and vertex count, which lets
+  // Cycles refit the existing BVH instead of building a new one
+  const bool topologyChanged = syncTopology(state);
+  const bool positionsChanged = topologyChanged
+      || state.changed("vertex.position", m_vertexPosition.get());
+
+  int changes = GEOMETRY_UNCHANGED;
+
+  // Written first, a chunk's triangles decide which vertices its node holds
+  if (topologyChanged) {
+    setPrimitiveIndex(mesh, state, chunk);
+    changes |= GEOMETRY_TOPOLOGY;
+  }
+
+  if (positionsChanged) {
+    setVertexPosition(mesh, state);
+    state.markSynced("vertex.position", m_vertexPosition.get());
+    changes |= GEOMETRY_POSITIONS;
   }
 
-  setVertexPosition(mesh);
-  setPrimitiveIndex(mesh);
-  setVertexNormal(mesh);
-  setVertexColor(mesh);
-  setVertexAttribute(mesh, m_vertexAttribute0, "vertex.attribute0");
-  setVertexAttribute(mesh, m_vertexAttribute1, "vertex.attribute1");
-  setVertexAttribute(mesh, m_vertexAttribute2, "vertex.attribute2");
-  setVertexAttribute(mesh, m_vertexAttribute3, "vertex.attribute3");
+  // Attribute storage is sized by the vertex or triangle count, so a topology
+  // change rewrites every attribute, otherwise only the arrays which changed
+  auto attributeChanged = [&](const char *name, const Array1D *array) {
+    return topologyChanged || state.changed(name, array);
+  };
+
+  // Normals Cycles generated itself go stale once the positions move
+  if (attributeChanged("vertex.normal", m_vertexNormal.get())
+      || (positionsChanged && !m_vertexNormal)) {
+    setVertexNormal(mesh, state);
+    state.markSynced("vertex.normal", m_vertexNormal.get());
+    changes |= GEOMETRY_ATTRIBUTES;
+  }
+
+  // Any of an attribute's inputs changing can change which one is used
+  for (const auto &a : attributeInputs()) {
+    const std::string fvParam = std::string("faceVarying.") + a.name;
+    const std::string vParam = std::string("vertex.") + a.name;
+    const std::string pParam = std::string("primitive.") + a.name;
+    if (!attributeChanged(fvParam.c_str(), a.faceVarying)
+        && !attributeChanged(vParam.c_str(), a.vertex)
+        && !attributeChanged(pParam.c_str(), a.primitive))
+      continue;
+    setAttribute(mesh, state, a);
+    state.markSynced(fvParam.c_str(), a.faceVarying);
+    state.markSynced(vParam.c_str(), a.vertex);
+    state.markSynced(pParam.c_str(), a.primitive);
+    changes |= GEOMETRY_ATTRIBUTES;
+  }
+
+  return changes;
 }
 
 box3 Triangle::bounds() const
@@ -126,91 +364,444 @@ box3 Triangle::bounds() const
   return b;
 }
 
-void Triangle::setVertexPosition(ccl::Mesh *mesh) const
+size_t Triangle::numPrimitives() const
 {
-  ccl::array<ccl::float3> P;
-  auto *dst = P.resize(m_vertexPosition->size());
-  std::transform(m_vertexPosition->beginAs<anari_vec::float3>(),
-      m_vertexPosition->endAs<anari_vec::float3>(),
-      dst,
-      [](const anari_vec::float3 &v) { return make_float3(v[0], v[1], v[2]); });
-  mesh->set_verts(P);
+  if (!m_vertexPosition)
+    return 0;
+  return m_index ? m_index->size() : m_vertexPosition->size() / 3;
 }
 
-void Triangle::setPrimitiveIndex(ccl::Mesh *mesh) const
+void Triangle::computePrimitiveCenters(float3 *centers) const
 {
-  const uint32_t numTriangles =
-      m_index ? m_index->size() : m_vertexPosition->size() / 3;
-  mesh->reserve_mesh(numTriangles * 3, numTriangles);
-  for (uint32_t i = 0; i < numTriangles; i++) {
-    if (m_index) {
-      auto *idxs = m_index->beginAs<anari_vec::uint3>();
-      mesh->add_triangle(
-          idxs[i][0], idxs[i][1], idxs[i][2], 0 /* local shaderID */, true);
-    } else {
-      mesh->add_triangle(
-          3 * i + 0, 3 * i + 1, 3 * i + 2, 0 /* local shaderID */, true);
+  const auto *P = m_vertexPosition->beginAs<anari_vec::float3>();
+  const auto *idx = m_index ? m_index->beginAs<anari_vec::uint3>() : nullptr;
+  auto vertex = [&](uint32_t v) {
+    return make_float3(P[v][0], P[v][1], P[v][2]);
+  };
+
+  parallelForChunks(numPrimitives(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      uint32_t t[3] = {
+          uint32_t(3 * i), uint32_t(3 * i + 1), uint32_t(3 * i + 2)};
+      if (idx)
+        std::copy_n(&idx[i][0], 3, t);
+      centers[i] = (vertex(t[0]) + vertex(t[1]) + vertex(t[2])) * (1.f / 3.f);
+    }
+  });
+}
+
+bool Triangle::syncTopology(GeometrySyncState &state) const
+{
+  const size_t numVertices = m_vertexPosition ? m_vertexPosition->size() : 0;
+  bool changed = state.changed("primitive.index", m_index.get())
+      || state.numVertices != numVertices
+      || state.changed("preprocess", m_preprocessChanged);
+  state.markSynced("primitive.index", m_index.get());
+  state.markSynced("preprocess");
+  state.numVertices = numVertices;
+
+  // Which vertices get welded and which triangles are degenerate depends on
+  // the vertex data itself, so preprocessed meshes can't simply be refit
+  if (m_preprocess) {
+    const char *names[] = {"vertex.position",
+        "vertex.normal",
+        "vertex.color",
+        "vertex.attribute0",
+        "vertex.attribute1",
+        "vertex.attribute2",
+        "vertex.attribute3"};
+    const auto arrays = vertexArrays();
+    for (size_t i = 0; i < arrays.size(); i++) {
+      changed |= state.changed(names[i], arrays[i]);
+      state.markSynced(names[i], arrays[i]);
     }
   }
+
+  return changed;
 }
 
-void Triangle::setVertexNormal(ccl::Mesh *mesh) const
+size_t Triangle::numNodeVertices(const GeometrySyncState &state) const
 {
-  if (!m_vertexNormal)
-    return;
+  return vertexGather(state) ? state.vertexGather.size()
+                             : m_vertexPosition->size();
+}
 
-  ustring name = ustring("vertex.normal");
-  Attribute *attr = mesh->attributes.add(ATTR_STD_VERTEX_NORMAL, name);
-  float3 *dst = attr->data_float3();
-  std::transform(m_vertexNormal->beginAs<anari_vec::float3>(),
-      m_vertexNormal->endAs<anari_vec::float3>(),
-      dst,
-      [](const anari_vec::float3 &v) { return make_float3(v[0], v[1], v[2]); });
+void Triangle::setVertexPosition(
+    ccl::Mesh *mesh, const GeometrySyncState &state) const
+{
+  ccl::array<ccl::float3> P;
+  const size_t numVertices = numNodeVertices(state);
+  convertArray(m_vertexPosition.get(),
+      P.resize(numVertices),
+      numVertices,
+      vertexGather(state));
+  mesh->set_verts(P);
 }
 
-void Triangle::setVertexColor(ccl::Mesh *mesh) const
+void Triangle::setPrimitiveIndex(ccl::Mesh *mesh,
+    GeometrySyncState &state,
+    const GeometryChunk *chunk) const
 {
-  auto &array = m_vertexColor;
-  if (!array)
-    return;
+  const uint32_t *srcIdx = nullptr;
+  if (m_index)
+    srcIdx = (const uint32_t *)m_index->beginAs<anari_vec::uint3>();
+
+  auto &gather = state.vertexGather;
+  gather.clear();
+  state.primitiveGather.clear();
+  state.removedPrimitives = 0;
+  state.weldedVertices = 0;
+
+  // Chunks and preprocessed meshes hold their own subset of the vertices,
+  // so they go through a list of corners into the full geometry first, along
+  // with the triangle each one came from for per-primitive attributes
+  std::vector<uint32_t> corners;
+  std::vector<uint32_t> &primitives = state.primitiveGather;
+  if (chunk || m_preprocess) {
+    const size_t numTriangles = chunk ? chunk->numPrimitives : numPrimitives();
+    corners.resize(numTriangles * 3);
+    primitives.resize(numTriangles);
+    parallelForChunks(numTriangles, [&](size_t begin, size_t end) {
+      for (size_t t = begin; t < end; t++) {
+        const size_t tri = chunk ? chunk->primitives[t] : t;
+        primitives[t] = uint32_t(tri);
+        for (size_t k = 0; k < 3; k++) {
+          corners[3 * t + k] =
+              srcIdx ? srcIdx[3 * tri + k] : uint32_t(3 * tri + k);
+        }
+      }
+    });
+    // Chunks are already in Morton order
+    if (m_preprocess)
+      preprocessTriangles(corners, primitives, state, !chunk);
+  }
 
-  const void *src = array->data();
-  anari::DataType type = array->elementType();
+  const size_t numTriangles =
+      chunk || m_preprocess ? corners.size() / 3 : numPrimitives();
 
-  Attribute *attr = mesh->attributes.add(
-      ustring("vertex.color"), ccl::TypeColor, ATTR_ELEMENT_VERTEX);
-  attr->std = ATTR_STD_VERTEX_COLOR;
-  float3 *dst = attr->data_float3();
-  for (uint32_t i = 0; i < array->size(); i++) {
-    auto c = anari::anariTypeInvoke<anari_vec::float4, convert_toFloat4>(
-        type, src, i);
-    dst[i] = make_float3(c[0], c[1], c[2]);
+  // Replace the whole triangle buffer, appending through add_triangle() would
+  // stack the new triangles on top of the ones from the previous sync
+  ccl::array<int> triangles;
+  ccl::array<int> shader;
+  ccl::array<bool> smooth;
+  int *dstIdx = triangles.resize(numTriangles * 3);
+  std::fill_n(shader.resize(numTriangles), numTriangles, 0);
+  std::fill_n(smooth.resize(numTriangles), numTriangles, true);
+
+  if (chunk || m_preprocess) {
+    // Number the vertices in the order the triangles first use them, so
+    // spatially sorted triangles also get spatially sorted vertices: find
+    // the first corner of every vertex, then count those corners in order
+    const size_t numCorners = corners.size();
+    std::vector<std::atomic<uint32_t>> firstCorner(vertexTableSize(corners));
+    parallelForChunks(firstCorner.size(), [&](size_t begin, size_t end) {
+      for (size_t v = begin; v < end; v++)
+        firstCorner[v].store(~0u, std::memory_order_relaxed);
+    });
+    parallelForChunks(numCorners, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++)
+        atomicMin(firstCorner[corners[i]], uint32_t(i));
+    });
+
+    std::vector<uint32_t> nodeIndex(numCorners + 1);
+    parallelForChunks(numCorners, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        nodeIndex[i] = firstCorner[corners[i]].load(std::memory_order_relaxed)
+            == uint32_t(i);
+      }
+    });
+    std::exclusive_scan(
+        nodeIndex.begin(), nodeIndex.end(), nodeIndex.begin(), 0u);
+
+    gather.resize(nodeIndex[numCorners]);
+    parallelForChunks(numCorners, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        const uint32_t first =
+            firstCorner[corners[i]].load(std::memory_order_relaxed);
+        dstIdx[i] = int(nodeIndex[first]);
+        if (first == i)
+          gather[nodeIndex[i]] = corners[i];
+      }
+    });
+  } else if (srcIdx) {
+    parallelForChunks(numTriangles * 3, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++)
+        dstIdx[i] = int(srcIdx[i]);
+    });
+  } else {
+    std::iota(dstIdx, dstIdx + numTriangles * 3, 0);
   }
+
+  mesh->set_triangles(triangles);
+  mesh->set_shader(shader);
+  mesh->set_smooth(smooth);
 }
 
-void Triangle::setVertexAttribute(ccl::Mesh *mesh,
-    const helium::IntrusivePtr<Array1D> &array,
-    const char *name) const
+std::array<const Array1D *, 7> Triangle::vertexArrays() const
 {
-  if (!array)
+  return {m_vertexPosition.get(),
+      m_vertexNormal.get(),
+      m_vertexColor.get(),
+      m_vertexAttribute0.get(),
+      m_vertexAttribute1.get(),
+      m_vertexAttribute2.get(),
+      m_vertexAttribute3.get()};
+}
+
+uint64_t Triangle::hashVertex(uint32_t v) const
+{
+  // FNV-1a over the bytes of every per-vertex input
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const auto *array : vertexArrays()) {
+    if (!array || v >= array->size())
+      continue;
+    const size_t size = anari::sizeOf(array->elementType());
+    const auto *bytes = (const uint8_t *)array->data() + v * size;
+    for (size_t i = 0; i < size; i++)
+      hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+bool Triangle::sameVertex(uint32_t a, uint32_t b) const
+{
+  for (const auto *array : vertexArrays()) {
+    if (!array)
+      continue;
+    const bool hasA = a < array->size();
+    const bool hasB = b < array->size();
+    if (hasA != hasB)
+      return false;
+    if (!hasA)
+      continue;
+    const size_t size = anari::sizeOf(array->elementType());
+    const auto *bytes = (const uint8_t *)array->data();
+    if (std::memcmp(bytes + a * size, bytes + b * size, size) != 0)
+      return false;
+  }
+  return true;
+}
+
+void Triangle::preprocessTriangles(std::vector<uint32_t> &corners,
+    std::vector<uint32_t> &primitives,
+    GeometrySyncState &state,
+    bool reorder) const
+{
+  const size_t numTriangles = corners.size() / 3;
+
+  // Weld vertices whose inputs are all bit identical, equal hashes are
+  // confirmed byte by byte and the lowest index of each group is kept
+  std::vector<uint32_t> used = corners;
+  tbb::parallel_sort(used.begin(), used.end());
+  used.erase(std::unique(used.begin(), used.end()), used.end());
+
+  std::vector<std::pair<uint64_t, uint32_t>> keys(used.size());
+  parallelForChunks(used.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      keys[i] = {hashVertex(used[i]), used[i]};
+  });
+  tbb::parallel_sort(keys.begin(), keys.end());
+
+  // Runs of equal hashes are independent once sorted, so each is welded by
+  // whichever task finds its start, into a table indexed by vertex
+  std::vector<uint32_t> welded(vertexTableSize(corners));
+  std::atomic<size_t> numWelded{0};
+  parallelForChunks(keys.size(), [&](size_t begin, size_t end) {
+    for (size_t run = begin; run < end; run++) {
+      if (run > 0 && keys[run - 1].first == keys[run].first)
+        continue;
+      size_t runEnd = run + 1;
+      while (runEnd < keys.size() && keys[runEnd].first == keys[run].first)
+        runEnd++;
+      for (size_t j = run; j < runEnd; j++) {
+        uint32_t v = keys[j].second;
+        for (size_t k = run; k < j; k++) {
+          const uint32_t candidate = keys[k].second;
+          if (welded[candidate] == candidate && sameVertex(candidate, v)) {
+            v = candidate;
+            numWelded++;
+            break;
+          }
+        }
+        welded[keys[j].second] = v;
+      }
+    }
+  });
+  state.weldedVertices = numWelded;
+
+  auto *P = m_vertexPosition->beginAs<anari_vec::float3>();
+  auto vertex = [&](uint32_t v) {
+    return make_float3(P[v][0], P[v][1], P[v][2]);
+  };
+
+  // Drop triangles which lost a corner to welding or have no area, kept ones
+  // are scattered to the prefix sum of the flags before them
+  std::vector<uint32_t> keptIndex(numTriangles + 1, 0);
+  parallelForChunks(numTriangles, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      uint32_t *c = corners.data() + 3 * t;
+      for (size_t k = 0; k < 3; k++)
+        c[k] = welded[c[k]];
+      const float3 n =
+          cross(vertex(c[1]) - vertex(c[0]), vertex(c[2]) - vertex(c[0]));
+      keptIndex[t] = c[0] != c[1] && c[1] != c[2] && c[0] != c[2]
+          && (n.x != 0.f || n.y != 0.f || n.z != 0.f);
+    }
+  });
+
+  std::exclusive_scan(
+      keptIndex.begin(), keptIndex.end(), keptIndex.begin(), 0u);
+  const size_t numKept = keptIndex[numTriangles];
+
+  std::vector<uint32_t> keptCorners(numKept * 3);
+  std::vector<uint32_t> keptPrimitives(numKept);
+  parallelForChunks(numTriangles, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      if (keptIndex[t + 1] == keptIndex[t])
+        continue;
+      std::copy_n(&corners[3 * t], 3, &keptCorners[3 * keptIndex[t]]);
+      keptPrimitives[keptIndex[t]] = primitives[t];
+    }
+  });
+  corners = std::move(keptCorners);
+  primitives = std::move(keptPrimitives);
+  state.removedPrimitives = numTriangles - numKept;
+
+  if (!reorder)
     return;
 
-  anari::DataType type = array->elementType();
-  const void *src = array->data();
-
-  Attribute *attr =
-      mesh->attributes.add(ustring(name), ccl::TypeFloat4, ATTR_ELEMENT_VERTEX);
-  float4 *dst = attr->data_float4();
-  size_t i = 0;
-  std::for_each(dst, dst + m_vertexPosition->size(), [&](float4 &v) {
-    auto r = anari::anariTypeInvoke<anari_vec::float4, convert_toFloat4>(
-        type, src, i);
-    v.x = r[0];
-    v.y = r[1];
-    v.z = r[2];
-    v.w = r[3];
-    i++;
+  // Spatially sort what's left for better BVH builds and memory locality
+  std::vector<float3> centers(numKept);
+  parallelForChunks(numKept, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      const uint32_t *c = corners.data() + 3 * t;
+      centers[t] = (vertex(c[0]) + vertex(c[1]) + vertex(c[2])) * (1.f / 3.f);
+    }
+  });
+
+  const auto order = mortonOrder(centers.data(), numKept);
+  std::vector<uint32_t> sorted(corners.size());
+  std::vector<uint32_t> sortedPrimitives(numKept);
+  parallelForChunks(numKept, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      std::copy_n(&corners[3 * order[t]], 3, &sorted[3 * t]);
+      sortedPrimitives[t] = primitives[order[t]];
+    }
   });
+  corners = std::move(sorted);
+  primitives = std::move(sortedPrimitives);
+}
+
+void Triangle::setVertexNormal(
+    ccl::Mesh *mesh, const GeometrySyncState &state) const
+{
+  mesh->attributes.remove(ATTR_STD_VERTEX_NORMAL);
+  if (!m_vertexNormal)
+    return;
+
+  ustring name = ustring("vertex.normal");
+  Attribute *attr = mesh->attributes.add(ATTR_STD_VERTEX_NORMAL, name);
+  convertArray(m_vertexNormal.get(),
+      attr->data_float3(),
+      numNodeVertices(state),
+      vertexGather(state));
+}
+
+std::array<Triangle::AttributeInputs, 5> Triangle::attributeInputs() const
+{
+  return {{{"color",
+               m_faceVaryingColor.get(),
+               m_vertexColor.get(),
+               m_primitiveColor.get()},
+      {"attribute0",
+          m_faceVaryingAttribute0.get(),
+          m_vertexAttribute0.get(),
+          m_primitiveAttribute0.get()},
+      {"attribute1",
+          m_faceVaryingAttribute1.get(),
+          m_vertexAttribute1.get(),
+          m_primitiveAttribute1.get()},
+      {"attribute2",
+          m_faceVaryingAttribute2.get(),
+          m_vertexAttribute2.get(),
+          m_primitiveAttribute2.get()},
+      {"attribute3",
+          m_faceVaryingAttribute3.get(),
+          m_vertexAttribute3.get(),
+          m_primitiveAttribute3.get()}}};
+}
+
+void Triangle::setAttribute(ccl::Mesh *mesh,
+    const GeometrySyncState &state,
+    const AttributeInputs &inputs) const
+{
+  const ustring name(inputs.name);
+  mesh->attributes.remove(name);
+
+  const bool isColor = name == "color";
+  auto isByteColor = [&](const Array1D *array) {
+    return isColor && array->elementType() == ANARI_UFIXED8_RGBA_SRGB;
+  };
+
+  // Face-varying and per-primitive data keep their own element, so indexed
+  // meshes never have to be expanded to one vertex per corner
+  const size_t numTriangles = mesh->num_triangles();
+  const uint32_t *primitives = primitiveGather(state);
+  Attribute *attr = nullptr;
+
+  // Reads of these are gathered, finalize() warned about ones too short
+  const size_t numSourceTriangles = numPrimitives();
+  auto sized = [](const Array1D *array, size_t count) {
+    return array && array->size() >= count ? array : nullptr;
+  };
+  const Array1D *faceVarying =
+      sized(inputs.faceVarying, numSourceTriangles * 3);
+  const Array1D *primitive = sized(inputs.primitive, numSourceTriangles);
+
+  if (faceVarying) {
+    std::vector<uint32_t> corners;
+    if (primitives) {
+      corners.resize(numTriangles * 3);
+      parallelForChunks(numTriangles, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+          for (uint32_t k = 0; k < 3; k++)
+            corners[3 * t + k] = 3 * primitives[t] + k;
+        }
+      });
+    }
+    if (!primitives && isByteColor(faceVarying)) {
+      attr = addByteColorCorners(mesh, faceVarying);
+    } else {
+      attr = addConvertedAttribute(mesh->attributes,
+          name,
+          ATTR_ELEMENT_CORNER,
+          faceVarying,
+          numTriangles * 3,
+          primitives ? corners.data() : nullptr);
+    }
+  } else if (inputs.vertex) {
+    // Non-indexed meshes have one vertex per corner
+    if (!m_index && !vertexGather(state) && isByteColor(inputs.vertex)) {
+      attr = addByteColorCorners(mesh, inputs.vertex);
+    } else {
+      attr = addConvertedAttribute(mesh->attributes,
+          name,
+          ATTR_ELEMENT_VERTEX,
+          inputs.vertex,
+          numNodeVertices(state),
+          vertexGather(state));
+    }
+  } else if (primitive) {
+    attr = addConvertedAttribute(mesh->attributes,
+        name,
+        ATTR_ELEMENT_FACE,
+        primitive,
+        numTriangles,
+        primitives);
+  }
+
+  if (attr && isColor)
+    attr->std = ATTR_STD_VERTEX_COLOR;
 }
 
 // Sphere definitions /////////////////////////////////////////////////////////
@@ -224,27 +815,50 @@ struct Sphere : public Geometry
   void finalize() override;
 
   ccl::Geometry *createCyclesGeometryNode() override;
-  void syncCyclesNode(ccl::Geometry *node) const override;
+  int syncCyclesNode(ccl::Geometry *node,
+      GeometrySyncState &state,
+      const GeometryChunk *chunk) const override;
 
   box3 bounds() const override;
 
+ protected:
+  size_t numPrimitives() const override;
+  void computePrimitiveCenters(float3 *centers) const override;
+  bool syncTopology(GeometrySyncState &state) const override;
+
  private:
-  void setSpheres(ccl::PointCloud *pc) const;
-  void setAttributes(ccl::PointCloud *pc) const;
+  size_t numNodeSpheres(const GeometrySyncState &state) const;
+  const uint32_t *sphereGather(const GeometrySyncState &state) const;
+  void setSpheres(ccl::PointCloud *pc,
+      GeometrySyncState &state,
+      const GeometryChunk *chunk) const;
+  void setAttribute(ccl::PointCloud *pc,
+      const GeometrySyncState &state,
+      const Array1D *array,
+      const char *name) const;
 
   helium::ChangeObserverPtr<Array1D> m_index;
   helium::ChangeObserverPtr<Array1D> m_vertexPosition;
-  helium::IntrusivePtr<Array1D> m_vertexColor;
-  helium::IntrusivePtr<Array1D> m_vertexAttribute0;
-  helium::IntrusivePtr<Array1D> m_vertexAttribute1;
-  helium::IntrusivePtr<Array1D> m_vertexAttribute2;
-  helium::IntrusivePtr<Array1D> m_vertexAttribute3;
-  helium::IntrusivePtr<Array1D> m_vertexRadius;
+  helium::ChangeObserverPtr<Array1D> m_vertexColor;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute0;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute1;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute2;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute3;
+  helium::ChangeObserverPtr<Array1D> m_vertexRadius;
   float m_radius{1.f};
+  helium::TimeStamp m_radiusChanged{0};
 };
 
 Sphere::Sphere(CyclesGlobalState *s)
-    : Geometry(s), m_index(this), m_vertexPosition(this)
+    : Geometry(s),
+      m_index(this),
+      m_vertexPosition(this),
+      m_vertexColor(this),
+      m_vertexAttribute0(this),
+      m_vertexAttribute1(this),
+      m_vertexAttribute2(this),
+      m_vertexAttribute3(this),
+      m_vertexRadius(this)
 {}
 
 Sphere::~Sphere() = default;
@@ -261,7 +875,12 @@ void Sphere::commitParameters()
   m_vertexAttribute2 = getParamObject<Array1D>("vertex.attribute2");
   m_vertexAttribute3 = getParamObject<Array1D>("vertex.attribute3");
   m_vertexRadius = getParamObject<Array1D>("vertex.radius");
-  m_radius = getParam<float>("radius", 1.f);
+
+  const float radius = getParam<float>("radius", 1.f);
+  if (radius != m_radius) {
+    m_radius = radius;
+    m_radiusChanged = helium::newTimeStamp();
+  }
 }
 
 void Sphere::finalize()
@@ -269,6 +888,15 @@ void Sphere::finalize()
   if (!m_vertexPosition) {
     reportMessage(ANARI_SEVERITY_WARNING,
         "missing required parameter 'vertex.position' on sphere geometry");
+  } else {
+    warnShortVertexArrays("sphere",
+        m_vertexPosition->size(),
+        {{"vertex.radius", m_vertexRadius.get()},
+            {"vertex.color", m_vertexColor.get()},
+            {"vertex.attribute0", m_vertexAttribute0.get()},
+            {"vertex.attribute1", m_vertexAttribute1.get()},
+            {"vertex.attribute2", m_vertexAttribute2.get()},
+            {"vertex.attribute3", m_vertexAttribute3.get()}});
   }
 
   Geometry::finalize();
@@ -279,16 +907,58 @@ ccl::Geometry *Sphere::createCyclesGeometryNode()
   return deviceState()->scene->create_node<ccl::PointCloud>();
 }
 
-void Sphere::syncCyclesNode(ccl::Geometry *node) const
+int Sphere::syncCyclesNode(ccl::Geometry *node,
+    GeometrySyncState &state,
+    const GeometryChunk *chunk) const
 {
   if (!m_vertexPosition) {
     reportMessage(ANARI_SEVERITY_WARNING,
         "Spheres::syncCyclesNode() detected incomplete geometry");
+    return GEOMETRY_UNCHANGED;
   }
 
   auto *pc = (ccl::PointCloud *)node;
-  setSpheres(pc);
-  setAttributes(pc);
+
+  // Moving points only needs a refit, a different point count a rebuild
+  const bool topologyChanged = syncTopology(state);
+  const bool indexChanged =
+      topologyChanged || state.changed("primitive.index", m_index.get());
+  const bool spheresChanged = indexChanged
+      || state.changed("vertex.position", m_vertexPosition.get())
+      || state.changed("vertex.radius", m_vertexRadius.get())
+      || state.changed("radius", m_radiusChanged);
+
+  int changes = GEOMETRY_UNCHANGED;
+
+  if (spheresChanged) {
+    setSpheres(pc, state, chunk);
+    state.markSynced("primitive.index", m_index.get());
+    state.markSynced("vertex.position", m_vertexPosition.get());
+    state.markSynced("vertex.radius", m_vertexRadius.get());
+    state.markSynced("radius");
+    changes |= GEOMETRY_POSITIONS;
+  }
+
+  if (topologyChanged)
+    changes |= GEOMETRY_TOPOLOGY;
+
+  // Attributes are gathered through the index, so follow its changes too
+  auto syncAttribute =
+      [&](const Array1D *array, const char *param, const char *name) {
+        if (!indexChanged && !state.changed(param, array))
+          return;
+        setAttribute(pc, state, array, name);
+        state.markSynced(param, array);
+        changes |= GEOMETRY_ATTRIBUTES;
+      };
+
+  syncAttribute(m_vertexColor.get(), "vertex.color", "color");
+  syncAttribute(m_vertexAttribute0.get(), "vertex.attribute0", "attribute0");
+  syncAttribute(m_vertexAttribute1.get(), "vertex.attribute1", "attribute1");
+  syncAttribute(m_vertexAttribute2.get(), "vertex.attribute2", "attribute2");
+  syncAttribute(m_vertexAttribute3.get(), "vertex.attribute3", "attribute3");
+
+  return changes;
 }
 
 box3 Sphere::bounds() const
@@ -304,142 +974,878 @@ box3 Sphere::bounds() const
   return b;
 }
 
-void Sphere::setSpheres(ccl::PointCloud *pc) const
+size_t Sphere::numPrimitives() const
+{
+  if (!m_vertexPosition)
+    return 0;
+  return m_index ? m_index->size() : m_vertexPosition->size();
+}
+
+void Sphere::computePrimitiveCenters(float3 *centers) const
+{
+  convertArray(m_vertexPosition.get(),
+      centers,
+      numPrimitives(),
+      m_index ? m_index->beginAs<uint32_t>() : nullptr);
+}
+
+bool Sphere::syncTopology(GeometrySyncState &state) const
+{
+  const size_t numSpheres = numPrimitives();
+  const bool changed = state.numPrimitives != numSpheres;
+  state.numPrimitives = numSpheres;
+  return changed;
+}
+
+size_t Sphere::numNodeSpheres(const GeometrySyncState &state) const
+{
+  return vertexGather(state) ? state.vertexGather.size() : numPrimitives();
+}
+
+// Vertex of each sphere the node holds
+const uint32_t *Sphere::sphereGather(const GeometrySyncState &state) const
+{
+  if (auto *gather = vertexGather(state); gather)
+    return gather;
+  return m_index ? m_index->beginAs<uint32_t>() : nullptr;
+}
+
+void Sphere::setSpheres(ccl::PointCloud *pc,
+    GeometrySyncState &state,
+    const GeometryChunk *chunk) const
 {
   ccl::array<ccl::float3> points;
   ccl::array<float> radius;
   ccl::array<int> shader;
 
-  size_t numSpheres = m_index ? m_index->size() : m_vertexPosition->size();
+  // A chunk's node holds its own spheres, in Morton order
+  state.vertexGather.clear();
+  if (chunk) {
+    const auto *index = m_index ? m_index->beginAs<uint32_t>() : nullptr;
+    state.vertexGather.resize(chunk->numPrimitives);
+    std::transform(chunk->primitives,
+        chunk->primitives + chunk->numPrimitives,
+        state.vertexGather.begin(),
+        [&](uint32_t p) { return index ? index[p] : p; });
+  }
 
-  auto *dstPoint = (ccl::float3 *)points.resize(numSpheres);
-  auto *dstRadius = (float *)radius.resize(numSpheres);
-  auto *dstShader = (int *)shader.resize(numSpheres);
+  const size_t numSpheres = numNodeSpheres(state);
+  const uint32_t *srcIdx = sphereGather(state);
 
-  const auto *srcPoint = m_vertexPosition->beginAs<anari_vec::float3>();
-  const float *srcRadius = nullptr;
-  if (m_vertexRadius)
-    srcRadius = m_vertexRadius->beginAs<float>();
+  convertArray(
+      m_vertexPosition.get(), points.resize(numSpheres), numSpheres, srcIdx);
 
-  const uint32_t *srcIdx = nullptr;
-  if (m_index)
-    srcIdx = m_index->beginAs<uint32_t>();
+  float *dstRadius = radius.resize(numSpheres);
+  if (m_vertexRadius)
+    convertArray(m_vertexRadius.get(), dstRadius, numSpheres, srcIdx);
+  else
+    std::fill_n(dstRadius, numSpheres, m_radius);
 
-  for (size_t i = 0; i < numSpheres; i++) {
-    size_t idx = srcIdx ? size_t(srcIdx[i]) : i;
-    const auto &pt = srcPoint[idx];
-    dstPoint[i] = make_float3(pt[0], pt[1], pt[2]);
-    dstRadius[i] = srcRadius ? srcRadius[idx] : m_radius;
-    dstShader[i] = 0;
-  }
+  std::fill_n(shader.resize(numSpheres), numSpheres, 0);
 
   pc->set_points(points);
   pc->set_radius(radius);
   pc->set_shader(shader);
 }
 
-void Sphere::setAttributes(ccl::PointCloud *pc) const
+void Sphere::setAttribute(ccl::PointCloud *pc,
+    const GeometrySyncState &state,
+    const Array1D *array,
+    const char *name) const
 {
-  float3 *dstC = nullptr;
-  float3 *dst0 = nullptr;
-  float3 *dst1 = nullptr;
-  float3 *dst2 = nullptr;
-  float3 *dst3 = nullptr;
+  pc->attributes.remove(ustring(name));
+  if (!array)
+    return;
 
-  const void *srcC = nullptr;
-  const void *src0 = nullptr;
-  const void *src1 = nullptr;
-  const void *src2 = nullptr;
-  const void *src3 = nullptr;
+  Attribute *attr = addConvertedAttribute(pc->attributes,
+      ustring(name),
+      ATTR_ELEMENT_VERTEX,
+      array,
+      numNodeSpheres(state),
+      sphereGather(state));
+  if (std::string_view(name) == "color")
+    attr->std = ATTR_STD_VERTEX_COLOR;
+}
 
-  anari::DataType srcTC = ANARI_UNKNOWN;
-  anari::DataType srcT0 = ANARI_UNKNOWN;
-  anari::DataType srcT1 = ANARI_UNKNOWN;
-  anari::DataType srcT2 = ANARI_UNKNOWN;
-  anari::DataType srcT3 = ANARI_UNKNOWN;
+// Curve definitions //////////////////////////////////////////////////////////
 
-  size_t numSpheres = m_index ? m_index->size() : m_vertexPosition->size();
+// 'curve', 'cylinder' and 'cone' geometry, all drawn as thick Cycles hair
+// curves built from the centerlines instead of tessellated tubes
+struct Curve : public Geometry
+{
+  enum Kind
+  {
+    CURVE, // independent segments, radius per vertex
+    CYLINDER, // independent segments, radius per primitive
+    CONE // independent segments, radius per vertex
+  };
 
-  if (m_vertexColor) {
-    Attribute *attr = pc->attributes.add(
-        ustring("vertex.color"), ccl::TypeColor, ATTR_ELEMENT_VERTEX);
-    attr->std = ATTR_STD_VERTEX_COLOR;
-    dstC = attr->data_float3();
-    srcC = m_vertexColor->data();
-    srcTC = m_vertexColor->elementType();
+  Curve(CyclesGlobalState *s, Kind kind);
+  ~Curve() override;
+
+  void commitParameters() override;
+  void finalize() override;
+
+  ccl::Geometry *createCyclesGeometryNode() override;
+  int syncCyclesNode(ccl::Geometry *node,
+      GeometrySyncState &state,
+      const GeometryChunk *chunk) const override;
+
+  box3 bounds() const override;
+
+ protected:
+  bool syncTopology(GeometrySyncState &state) const override;
+
+ private:
+  const char *kindName() const;
+  size_t numSegments() const;
+  uint32_t segmentVertex(size_t segment, size_t end) const;
+  void setCurves(ccl::Hair *hair, GeometrySyncState &state) const;
+  void setKeys(ccl::Hair *hair, const GeometrySyncState &state) const;
+
+  // Inputs of one Cycles attribute, per-vertex data wins over per-primitive
+  struct AttributeInputs
+  {
+    const char *name;
+    const Array1D *vertex;
+    const Array1D *primitive;
+  };
+  std::array<AttributeInputs, 5> attributeInputs() const;
+  void setAttribute(ccl::Hair *hair,
+      const GeometrySyncState &state,
+      const AttributeInputs &inputs) const;
+
+  Kind m_kind{CURVE};
+  helium::ChangeObserverPtr<Array1D> m_index;
+  helium::ChangeObserverPtr<Array1D> m_vertexPosition;
+  helium::ChangeObserverPtr<Array1D> m_vertexRadius;
+  helium::ChangeObserverPtr<Array1D> m_primitiveRadius;
+  helium::ChangeObserverPtr<Array1D> m_vertexColor;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute0;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute1;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute2;
+  helium::ChangeObserverPtr<Array1D> m_vertexAttribute3;
+  helium::ChangeObserverPtr<Array1D> m_primitiveColor;
+  helium::ChangeObserverPtr<Array1D> m_primitiveAttribute0;
+  helium::ChangeObserverPtr<Array1D> m_primitiveAttribute1;
+  helium::ChangeObserverPtr<Array1D> m_primitiveAttribute2;
+  helium::ChangeObserverPtr<Array1D> m_primitiveAttribute3;
+  float m_radius{1.f};
+  helium::TimeStamp m_radiusChanged{0};
+  bool m_joinSegments{false};
+  helium::TimeStamp m_joinSegmentsChanged{0};
+};
+
+Curve::Curve(CyclesGlobalState *s, Kind kind)
+    : Geometry(s),
+      m_kind(kind),
+      m_index(this),
+      m_vertexPosition(this),
+      m_vertexRadius(this),
+      m_primitiveRadius(this),
+      m_vertexColor(this),
+      m_vertexAttribute0(this),
+      m_vertexAttribute1(this),
+      m_vertexAttribute2(this),
+      m_vertexAttribute3(this),
+      m_primitiveColor(this),
+      m_primitiveAttribute0(this),
+      m_primitiveAttribute1(this),
+      m_primitiveAttribute2(this),
+      m_primitiveAttribute3(this)
+{}
+
+Curve::~Curve() = default;
+
+void Curve::commitParameters()
+{
+  Geometry::commitParameters();
+
+  m_index = getParamObject<Array1D>("primitive.index");
+  m_vertexPosition = getParamObject<Array1D>("vertex.position");
+  m_vertexRadius = getParamObject<Array1D>("vertex.radius");
+  m_primitiveRadius = getParamObject<Array1D>("primitive.radius");
+  m_vertexColor = getParamObject<Array1D>("vertex.color");
+  m_vertexAttribute0 = getParamObject<Array1D>("vertex.attribute0");
+  m_vertexAttribute1 = getParamObject<Array1D>("vertex.attribute1");
+  m_vertexAttribute2 = getParamObject<Array1D>("vertex.attribute2");
+  m_vertexAttribute3 = getParamObject<Array1D>("vertex.attribute3");
+  m_primitiveColor = getParamObject<Array1D>("primitive.color");
+  m_primitiveAttribute0 = getParamObject<Array1D>("primitive.attribute0");
+  m_primitiveAttribute1 = getParamObject<Array1D>("primitive.attribute1");
+  m_primitiveAttribute2 = getParamObject<Array1D>("primitive.attribute2");
+  m_primitiveAttribute3 = getParamObject<Array1D>("primitive.attribute3");
+
+  const float radius = getParam<float>("radius", 1.f);
+  if (radius != m_radius) {
+    m_radius = radius;
+    m_radiusChanged = helium::newTimeStamp();
   }
 
-  if (m_vertexAttribute0) {
-    Attribute *attr = pc->attributes.add(
-        ustring("vertex.attribute0"), ccl::TypeColor, ATTR_ELEMENT_VERTEX);
-    attr->std = ATTR_STD_VERTEX_COLOR;
-    dst0 = attr->data_float3();
-    src0 = m_vertexAttribute0->data();
-    srcT0 = m_vertexAttribute0->elementType();
+  // Only curves have segments sharing vertices which could be joined
+  const bool joinSegments =
+      m_kind == CURVE && getParam<bool>("joinSegments", false);
+  if (joinSegments != m_joinSegments) {
+    m_joinSegments = joinSegments;
+    m_joinSegmentsChanged = helium::newTimeStamp();
   }
+}
 
-  if (m_vertexAttribute1) {
-    Attribute *attr = pc->attributes.add(
-        ustring("vertex.attribute1"), ccl::TypeColor, ATTR_ELEMENT_VERTEX);
-    attr->std = ATTR_STD_VERTEX_COLOR;
-    dst1 = attr->data_float3();
-    src1 = m_vertexAttribute1->data();
-    srcT1 = m_vertexAttribute1->elementType();
+void Curve::finalize()
+{
+  if (!m_vertexPosition) {
+    reportMessage(ANARI_SEVERITY_WARNING,
+        "missing required parameter 'vertex.position' on %s geometry",
+        kindName());
   }
 
-  if (m_vertexAttribute2) {
-    Attribute *attr = pc->attributes.add(
-        ustring("vertex.attribute2"), ccl::TypeColor, ATTR_ELEMENT_VERTEX);
-    attr->std = ATTR_STD_VERTEX_COLOR;
-    dst2 = attr->data_float3();
-    src2 = m_vertexAttribute2->data();
-    srcT2 = m_vertexAttribute2->elementType();
+  if (m_kind == CONE && !m_vertexRadius) {
+    reportMessage(ANARI_SEVERITY_WARNING,
+        "missing required parameter 'vertex.radius' on cone geometry");
   }
 
-  if (m_vertexAttribute3) {
-    Attribute *attr = pc->attributes.add(
-        ustring("vertex.attribute3"), ccl::TypeColor, ATTR_ELEMENT_VERTEX);
-    attr->std = ATTR_STD_VERTEX_COLOR;
-    dst3 = attr->data_float3();
-    src3 = m_vertexAttribute3->data();
-    srcT3 = m_vertexAttribute3->elementType();
+  if (m_vertexPosition) {
+    warnShortVertexArrays(kindName(),
+        m_vertexPosition->size(),
+        {{"vertex.radius", m_vertexRadius.get()},
+            {"vertex.color", m_vertexColor.get()},
+            {"vertex.attribute0", m_vertexAttribute0.get()},
+            {"vertex.attribute1", m_vertexAttribute1.get()},
+            {"vertex.attribute2", m_vertexAttribute2.get()},
+            {"vertex.attribute3", m_vertexAttribute3.get()}});
   }
 
-  const uint32_t *srcIdx = nullptr;
+  // Reads of these are gathered, so setAttribute() ignores short arrays
+  const size_t numPrimitives = m_vertexPosition ? numSegments() : 0;
+  if (m_primitiveRadius && m_primitiveRadius->size() < numPrimitives) {
+    reportMessage(ANARI_SEVERITY_WARNING,
+        "'primitive.radius' on %s geometry has fewer elements than the "
+        "geometry has primitives, the missing values are read as zero",
+        kindName());
+  }
+  for (const auto &a : attributeInputs()) {
+    if (a.primitive && a.primitive->size() < numPrimitives) {
+      reportMessage(ANARI_SEVERITY_WARNING,
+          "ignoring 'primitive.%s' on %s geometry, it has fewer elements "
+          "than the geometry has primitives",
+          a.name,
+          kindName());
+    }
+  }
+
+  Geometry::finalize();
+}
+
+ccl::Geometry *Curve::createCyclesGeometryNode()
+{
+  auto *hair = deviceState()->scene->create_node<ccl::Hair>();
+  hair->curve_shape = ccl::CURVE_THICK;
+  return hair;
+}
+
+int Curve::syncCyclesNode(ccl::Geometry *node,
+    GeometrySyncState &state,
+    const GeometryChunk * /*chunk*/) const
+{
+  if (!m_vertexPosition) {
+    reportMessage(ANARI_SEVERITY_WARNING,
+        "Curve::syncCyclesNode() detected incomplete geometry");
+    return GEOMETRY_UNCHANGED;
+  }
+
+  auto *hair = (ccl::Hair *)node;
+
+  // Moving or resizing the keys only needs a refit, new segments a rebuild
+  const bool topologyChanged = syncTopology(state);
+  const bool keysChanged = topologyChanged
+      || state.changed("vertex.position", m_vertexPosition.get())
+      || state.changed("vertex.radius", m_vertexRadius.get())
+      || state.changed("primitive.radius", m_primitiveRadius.get())
+      || state.changed("radius", m_radiusChanged);
+
+  int changes = GEOMETRY_UNCHANGED;
+
+  // Written first, the curves decide which vertex each key is read from
+  if (topologyChanged) {
+    setCurves(hair, state);
+    changes |= GEOMETRY_TOPOLOGY;
+  }
+
+  if (keysChanged) {
+    setKeys(hair, state);
+    state.markSynced("vertex.position", m_vertexPosition.get());
+    state.markSynced("vertex.radius", m_vertexRadius.get());
+    state.markSynced("primitive.radius", m_primitiveRadius.get());
+    state.markSynced("radius");
+    changes |= GEOMETRY_POSITIONS;
+  }
+
+  // Attribute storage is sized by the key and curve counts, so a topology
+  // change rewrites every attribute, otherwise only the ones whose inputs
+  // changed, as either input changing can change which one is used
+  for (const auto &a : attributeInputs()) {
+    const std::string vParam = std::string("vertex.") + a.name;
+    const std::string pParam = std::string("primitive.") + a.name;
+    if (!topologyChanged && !state.changed(vParam.c_str(), a.vertex)
+        && !state.changed(pParam.c_str(), a.primitive))
+      continue;
+    setAttribute(hair, state, a);
+    state.markSynced(vParam.c_str(), a.vertex);
+    state.markSynced(pParam.c_str(), a.primitive);
+    changes |= GEOMETRY_ATTRIBUTES;
+  }
+
+  return changes;
+}
+
+box3 Curve::bounds() const
+{
+  box3 b = empty_box3();
+  if (!m_vertexPosition)
+    return b;
+  std::for_each(m_vertexPosition->beginAs<anari_vec::float3>(),
+      m_vertexPosition->endAs<anari_vec::float3>(),
+      [&](const anari_vec::float3 &v) {
+        extend(b, make_float3(v[0], v[1], v[2]));
+      });
+  return b;
+}
+
+bool Curve::syncTopology(GeometrySyncState &state) const
+{
+  const size_t numVertices = m_vertexPosition ? m_vertexPosition->size() : 0;
+  const bool changed = state.changed("primitive.index", m_index.get())
+      || state.changed("joinSegments", m_joinSegmentsChanged)
+      || state.numVertices != numVertices;
+  state.markSynced("primitive.index", m_index.get());
+  state.markSynced("joinSegments");
+  state.numVertices = numVertices;
+  return changed;
+}
+
+const char *Curve::kindName() const
+{
+  switch (m_kind) {
+  case CYLINDER:
+    return "cylinder";
+  case CONE:
+    return "cone";
+  case CURVE:
+  default:
+    return "curve";
+  }
+}
+
+size_t Curve::numSegments() const
+{
   if (m_index)
-    srcIdx = m_index->beginAs<uint32_t>();
-  for (size_t i = 0; i < numSpheres; i++) {
-    size_t idx = srcIdx ? size_t(srcIdx[i]) : i;
-    if (dstC) {
-      auto c = anari::anariTypeInvoke<anari_vec::float4, convert_toFloat4>(
-          srcTC, srcC, idx);
-      dstC[i] = make_float3(c[0], c[1], c[2]);
+    return m_index->size();
+  const size_t numVertices = m_vertexPosition->size();
+  if (m_kind == CURVE)
+    return numVertices > 0 ? numVertices - 1 : 0;
+  return numVertices / 2;
+}
+
+// Vertex at 'end' (0 or 1) of a segment
+uint32_t Curve::segmentVertex(size_t segment, size_t end) const
+{
+  if (m_kind == CURVE) {
+    const uint32_t first =
+        m_index ? m_index->beginAs<uint32_t>()[segment] : uint32_t(segment);
+    return first + uint32_t(end);
+  }
+  if (m_index)
+    return m_index->beginAs<uint32_t>()[2 * segment + end];
+  return uint32_t(2 * segment + end);
+}
+
+void Curve::setCurves(ccl::Hair *hair, GeometrySyncState &state) const
+{
+  const size_t numVertices = m_vertexPosition->size();
+  const size_t numPrims = numSegments();
+
+  // Segments naming a vertex past the end are skipped, a curve's index is
+  // its first vertex so it also needs the one after it
+  auto validSegment = [&](size_t i) {
+    if (m_kind == CURVE) {
+      const size_t first = m_index ? m_index->beginAs<uint32_t>()[i] : i;
+      return first + 1 < numVertices;
+    }
+    return segmentVertex(i, 0) < numVertices
+        && segmentVertex(i, 1) < numVertices;
+  };
+
+  std::vector<uint32_t> validIndex(numPrims + 1, 0);
+  parallelForChunks(numPrims, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      validIndex[i] = validSegment(i);
+  });
+  std::exclusive_scan(
+      validIndex.begin(), validIndex.end(), validIndex.begin(), 0u);
+
+  const size_t segments = validIndex[numPrims];
+  std::vector<uint32_t> segment(segments);
+  parallelForChunks(numPrims, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      if (validIndex[i + 1] != validIndex[i])
+        segment[validIndex[i]] = uint32_t(i);
     }
+  });
+  if (segments < numPrims) {
+    reportMessage(ANARI_SEVERITY_WARNING,
+        "skipping %zu %s segments whose vertices are out of range",
+        numPrims - segments,
+        kindName());
+  }
+
+  // Vertex each key is read from, the keys of a curve are consecutive, and
+  // the segment each Cycles curve came from for per-primitive attributes
+  auto &keys = state.vertexGather;
+  auto &primitives = state.primitiveGather;
+  ccl::array<int> firstKey;
+  ccl::array<int> shader;
 
-    if (dst0) {
-      auto c = anari::anariTypeInvoke<anari_vec::float4, convert_toFloat4>(
-          srcT0, src0, idx);
-      dst0[i] = make_float3(c[0], c[1], c[2]);
+  if (m_joinSegments) {
+    // Opted in: segments starting where the previous one ended extend the
+    // same Cycles curve, so a strand shares its keys instead of doubling
+    // them. Cycles interpolates the keys of a strand as a Catmull-Rom
+    // spline, so joined strands are smoothed rather than piecewise linear.
+    std::vector<uint8_t> startsCurve(segments);
+    parallelForChunks(segments, [&](size_t begin, size_t end) {
+      for (size_t j = begin; j < end; j++) {
+        startsCurve[j] = j == 0
+            || segmentVertex(segment[j - 1], 1)
+                != segmentVertex(segment[j], 0);
+      }
+    });
+
+    std::vector<uint32_t> keyOffset(segments);
+    std::vector<int> curveFirstKeys;
+    primitives.clear();
+    uint32_t numKeys = 0;
+    for (size_t j = 0; j < segments; j++) {
+      if (startsCurve[j]) {
+        curveFirstKeys.push_back(int(numKeys++));
+        primitives.push_back(segment[j]);
+      }
+      keyOffset[j] = numKeys++;
     }
 
-    if (dst1) {
-      auto c = anari::anariTypeInvoke<anari_vec::float4, convert_toFloat4>(
-          srcT1, src1, idx);
-      dst1[i] = make_float3(c[0], c[1], c[2]);
+    keys.resize(numKeys);
+    parallelForChunks(segments, [&](size_t begin, size_t end) {
+      for (size_t j = begin; j < end; j++) {
+        if (startsCurve[j])
+          keys[keyOffset[j] - 1] = segmentVertex(segment[j], 0);
+        keys[keyOffset[j]] = segmentVertex(segment[j], 1);
+      }
+    });
+
+    std::copy(curveFirstKeys.begin(),
+        curveFirstKeys.end(),
+        firstKey.resize(curveFirstKeys.size()));
+  } else {
+    // One straight two-key curve per segment, cylinder or cone, which keeps
+    // the shape exactly piecewise linear
+    keys.resize(2 * segments);
+    int *dstFirstKey = firstKey.resize(segments);
+    parallelForChunks(segments, [&](size_t begin, size_t end) {
+      for (size_t j = begin; j < end; j++) {
+        keys[2 * j] = segmentVertex(segment[j], 0);
+        keys[2 * j + 1] = segmentVertex(segment[j], 1);
+        dstFirstKey[j] = int(2 * j);
+      }
+    });
+
+    // Curves map to segments one to one unless some were skipped
+    if (segments < numPrims)
+      primitives = std::move(segment);
+    else
+      primitives.clear();
+  }
+
+  const size_t numCurves = firstKey.size();
+  std::fill_n(shader.resize(numCurves), numCurves, 0);
+
+  hair->set_curve_first_key(firstKey);
+  hair->set_curve_shader(shader);
+}
+
+void Curve::setKeys(ccl::Hair *hair, const GeometrySyncState &state) const
+{
+  const auto &keys = state.vertexGather;
+  const size_t numKeys = keys.size();
+
+  ccl::array<ccl::float3> P;
+  ccl::array<float> radius;
+  convertArray(m_vertexPosition.get(), P.resize(numKeys), numKeys, keys.data());
+
+  float *dstRadius = radius.resize(numKeys);
+  if (m_kind == CYLINDER && m_primitiveRadius) {
+    // Both keys of a cylinder take its primitive's radius
+    const auto &primitives = state.primitiveGather;
+    std::vector<uint32_t> keyPrimitive(numKeys);
+    parallelForChunks(numKeys, [&](size_t begin, size_t end) {
+      for (size_t k = begin; k < end; k++) {
+        keyPrimitive[k] =
+            primitives.empty() ? uint32_t(k / 2) : primitives[k / 2];
+      }
+    });
+    convertArray(
+        m_primitiveRadius.get(), dstRadius, numKeys, keyPrimitive.data());
+  } else if (m_kind != CYLINDER && m_vertexRadius) {
+    convertArray(m_vertexRadius.get(), dstRadius, numKeys, keys.data());
+  } else {
+    std::fill_n(dstRadius, numKeys, m_radius);
+  }
+
+  hair->set_curve_keys(P);
+  hair->set_curve_radius(radius);
+}
+
+std::array<Curve::AttributeInputs, 5> Curve::attributeInputs() const
+{
+  return {{{"color", m_vertexColor.get(), m_primitiveColor.get()},
+      {"attribute0", m_vertexAttribute0.get(), m_primitiveAttribute0.get()},
+      {"attribute1", m_vertexAttribute1.get(), m_primitiveAttribute1.get()},
+      {"attribute2", m_vertexAttribute2.get(), m_primitiveAttribute2.get()},
+      {"attribute3", m_vertexAttribute3.get(), m_primitiveAttribute3.get()}}};
+}
+
+void Curve::setAttribute(ccl::Hair *hair,
+    const GeometrySyncState &state,
+    const AttributeInputs &inputs) const
+{
+  const ustring name(inputs.name);
+  hair->attributes.remove(name);
+
+  // Reads of these are gathered, finalize() warned about ones too short
+  const Array1D *primitive =
+      inputs.primitive && inputs.primitive->size() >= numSegments()
+      ? inputs.primitive
+      : nullptr;
+
+  Attribute *attr = nullptr;
+  if (inputs.vertex) {
+    attr = addConvertedAttribute(hair->attributes,
+        name,
+        ATTR_ELEMENT_CURVE_KEY,
+        inputs.vertex,
+        state.vertexGather.size(),
+        state.vertexGather.data());
+  } else if (primitive) {
+    // Joined strands take the values of their first segment
+    attr = addConvertedAttribute(hair->attributes,
+        name,
+        ATTR_ELEMENT_CURVE,
+        primitive,
+        hair->num_curves(),
+        primitiveGather(state));
+  }
+
+  if (attr && name == "color")
+    attr->std = ATTR_STD_VERTEX_COLOR;
+}
+
+// Isosurface definitions ////////////////////////////////////////////////////
+
+// Triangles extracted by the device from a 'structuredRegular' field, one
+// surface per isovalue written straight into a single Cycles mesh
+struct Isosurface : public Geometry
+{
+  Isosurface(CyclesGlobalState *s);
+  ~Isosurface() override;
+
+  void commitParameters() override;
+  void finalize() override;
+
+  bool canMergeIntoCyclesMesh() const override;
+  ccl::Geometry *createCyclesGeometryNode() override;
+  int syncCyclesNode(ccl::Geometry *node,
+      GeometrySyncState &state,
+      const GeometryChunk *chunk) const override;
+
+  box3 bounds() const override;
+
+ protected:
+  bool syncTopology(GeometrySyncState &state) const override;
+
+ private:
+  const StructuredRegularField *regularField() const;
+  void extractSurfaces();
+
+  helium::ChangeObserverPtr<SpatialField> m_field;
+  helium::ChangeObserverPtr<Array1D> m_isovalueArray;
+  std::vector<float> m_isovalues;
+
+  // Surfaces stay valid while the field they came from is unchanged, so
+  // editing the isovalues only extracts the ones which are new
+  std::map<float, IsosurfaceMesh> m_surfaces;
+  const Array3D *m_extractedData{nullptr};
+  helium::TimeStamp m_extractedDataVersion{0};
+  float3 m_extractedOrigin{0.f, 0.f, 0.f};
+  float3 m_extractedSpacing{0.f, 0.f, 0.f};
+  helium::TimeStamp m_lastExtraction{0};
+  box3 m_bounds{empty_box3()};
+};
+
+Isosurface::Isosurface(CyclesGlobalState *s)
+    : Geometry(s), m_field(this), m_isovalueArray(this)
+{}
+
+Isosurface::~Isosurface() = default;
+
+void Isosurface::commitParameters()
+{
+  Geometry::commitParameters();
+
+  m_field = getParamObject<SpatialField>("field");
+  m_isovalueArray = getParamObject<Array1D>("isovalue");
+
+  // Either an array of values or a single one
+  std::vector<float> isovalues;
+  if (m_isovalueArray && m_isovalueArray->elementType() == ANARI_FLOAT32) {
+    const auto *begin = m_isovalueArray->beginAs<float>();
+    isovalues.assign(begin, begin + m_isovalueArray->size());
+  } else if (!m_isovalueArray) {
+    isovalues.push_back(getParam<float>(
+        "isovalue", std::numeric_limits<float>::quiet_NaN()));
+  }
+
+  // Repeated values would only add coincident triangles
+  m_isovalues.clear();
+  for (float v : isovalues) {
+    if (!std::isnan(v)
+        && std::find(m_isovalues.begin(), m_isovalues.end(), v)
+            == m_isovalues.end())
+      m_isovalues.push_back(v);
+  }
+}
+
+void Isosurface::finalize()
+{
+  if (!m_field) {
+    reportMessage(ANARI_SEVERITY_WARNING,
+        "missing required parameter 'field' on isosurface geometry");
+  } else if (!regularField()) {
+    reportMessage(ANARI_SEVERITY_WARNING,
+        "isosurface geometry only supports 'structuredRegular' fields");
+  }
+
+  if (m_isovalueArray && m_isovalueArray->elementType() != ANARI_FLOAT32) {
+    reportMessage(ANARI_SEVERITY_WARNING,
+        "isosurface geometry 'isovalue' array must be ANARI_FLOAT32");
+  } else if (m_isovalues.empty()) {
+    reportMessage(ANARI_SEVERITY_WARNING,
+        "missing required parameter 'isovalue' on isosurface geometry");
+  }
+
+  extractSurfaces();
+
+  Geometry::finalize();
+}
+
+bool Isosurface::canMergeIntoCyclesMesh() const
+{
+  return true;
+}
+
+ccl::Geometry *Isosurface::createCyclesGeometryNode()
+{
+  return deviceState()->scene->create_node<ccl::Mesh>();
+}
+
+int Isosurface::syncCyclesNode(ccl::Geometry *node,
+    GeometrySyncState &state,
+    const GeometryChunk * /*chunk*/) const
+{
+  auto *mesh = (ccl::Mesh *)node;
+
+  // Every extraction replaces the triangles, there is nothing to refit
+  if (!syncTopology(state))
+    return GEOMETRY_UNCHANGED;
+
+  std::vector<const IsosurfaceMesh *> surfaces;
+  std::vector<size_t> vertexOffset(1, 0);
+  std::vector<size_t> triangleOffset(1, 0);
+  for (float v : m_isovalues) {
+    auto it = m_surfaces.find(v);
+    if (it == m_surfaces.end())
+      continue;
+    surfaces.push_back(&it->second);
+    vertexOffset.push_back(vertexOffset.back() + it->second.vertices.size());
+    triangleOffset.push_back(
+        triangleOffset.back() + it->second.triangles.size() / 3);
+  }
+
+  const size_t numVertices = vertexOffset.back();
+  const size_t numTriangles = triangleOffset.back();
+
+  ccl::array<ccl::float3> verts;
+  ccl::array<int> triangles;
+  ccl::array<int> shader;
+  ccl::array<bool> smooth;
+  auto *dstVerts = verts.resize(numVertices);
+  auto *dstTriangles = triangles.resize(numTriangles * 3);
+  std::fill_n(shader.resize(numTriangles), numTriangles, 0);
+  std::fill_n(smooth.resize(numTriangles), numTriangles, true);
+
+  tbb::parallel_for(size_t(0), surfaces.size(), [&](size_t i) {
+    const auto &s = *surfaces[i];
+    const int base = int(vertexOffset[i]);
+    std::copy(s.vertices.begin(), s.vertices.end(), dstVerts + base);
+    std::transform(s.triangles.begin(),
+        s.triangles.end(),
+        dstTriangles + triangleOffset[i] * 3,
+        [&](int v) { return v + base; });
+  });
+
+  mesh->set_verts(verts);
+  mesh->set_triangles(triangles);
+  mesh->set_shader(shader);
+  mesh->set_smooth(smooth);
+
+  // Gradient normals are smoother than the ones Cycles would average from
+  // the faces, and match the field on a coarse grid
+  mesh->attributes.remove(ATTR_STD_VERTEX_NORMAL);
+  Attribute *attr = mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
+  float3 *N = attr->data_float3();
+  tbb::parallel_for(size_t(0), surfaces.size(), [&](size_t i) {
+    const auto &s = *surfaces[i];
+    std::copy(s.normals.begin(), s.normals.end(), N + vertexOffset[i]);
+  });
+
+  return GEOMETRY_TOPOLOGY;
+}
+
+box3 Isosurface::bounds() const
+{
+  return m_bounds;
+}
+
+bool Isosurface::syncTopology(GeometrySyncState &state) const
+{
+  const bool changed = state.changed("extraction", m_lastExtraction);
+  state.markSynced("extraction");
+  return changed;
+}
+
+const StructuredRegularField *Isosurface::regularField() const
+{
+  return dynamic_cast<const StructuredRegularField *>(m_field.get());
+}
+
+void Isosurface::extractSurfaces()
+{
+  const auto *field = regularField();
+  const Array3D *data =
+      field && field->isValid() ? field->m_data.ptr : nullptr;
+
+  // A different field, or new data in it, invalidates every surface
+  float3 origin = make_float3(0.f, 0.f, 0.f);
+  float3 spacing = make_float3(0.f, 0.f, 0.f);
+  if (data) {
+    origin = make_float3(
+        field->m_origin[0], field->m_origin[1], field->m_origin[2]);
+    spacing = make_float3(
+        field->m_spacing[0], field->m_spacing[1], field->m_spacing[2]);
+  }
+  const helium::TimeStamp dataVersion = data ? data->lastDataModified() : 0;
+  const bool fieldChanged = data != m_extractedData
+      || dataVersion != m_extractedDataVersion
+      || !isequal(origin, m_extractedOrigin)
+      || !isequal(spacing, m_extractedSpacing);
+
+  bool changed = fieldChanged && !m_surfaces.empty();
+  if (fieldChanged) {
+    m_surfaces.clear();
+    m_extractedData = data;
+    m_extractedDataVersion = dataVersion;
+    m_extractedOrigin = origin;
+    m_extractedSpacing = spacing;
+  }
+
+  for (auto it = m_surfaces.begin(); it != m_surfaces.end();) {
+    const bool used = std::find(m_isovalues.begin(), m_isovalues.end(),
+                          it->first) != m_isovalues.end();
+    if (used) {
+      ++it;
+    } else {
+      it = m_surfaces.erase(it);
+      changed = true;
     }
+  }
 
-    if (dst2) {
-      auto c = anari::anariTypeInvoke<anari_vec::float4, convert_toFloat4>(
-          srcT2, src2, idx);
-      dst2[i] = make_float3(c[0], c[1], c[2]);
+  if (data) {
+    IsosurfaceGrid grid;
+    grid.data = data->data();
+    grid.type = data->elementType();
+    const auto dims = data->size();
+    std::copy_n(&dims[0], 3, grid.dims);
+    grid.origin = origin;
+    grid.spacing = spacing;
+
+    size_t numTriangles = 0;
+    size_t numExtracted = 0;
+    for (float v : m_isovalues) {
+      if (m_surfaces.count(v) != 0)
+        continue;
+      m_surfaces[v] = extractIsosurface(grid, v);
+      numTriangles += m_surfaces[v].triangles.size() / 3;
+      numExtracted++;
+      changed = true;
     }
 
-    if (dst3) {
-      auto c = anari::anariTypeInvoke<anari_vec::float4, convert_toFloat4>(
-          srcT3, src3, idx);
-      dst3[i] = make_float3(c[0], c[1], c[2]);
+    if (numExtracted > 0) {
+      reportMessage(ANARI_SEVERITY_DEBUG,
+          "anari_cycles::Isosurface extracted %zu surfaces (%zu triangles)",
+          numExtracted,
+          numTriangles);
     }
   }
+
+  m_bounds = empty_box3();
+  for (const auto &s : m_surfaces)
+    extend(m_bounds, s.second.bounds);
+
+  if (changed || m_lastExtraction == 0)
+    m_lastExtraction = helium::newTimeStamp();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GeometrySyncState definitions //////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool GeometrySyncState::changed(const char *name, const Array *array) const
+{
+  auto it = m_arrays.find(name);
+  if (it == m_arrays.end())
+    return array != nullptr;
+  const auto &synced = it->second;
+  return synced.array != array
+      || (array && array->lastDataModified() > synced.lastSynced);
+}
+
+bool GeometrySyncState::changed(
+    const char *name, helium::TimeStamp lastModified) const
+{
+  auto it = m_arrays.find(name);
+  return it == m_arrays.end() || lastModified > it->second.lastSynced;
+}
+
+void GeometrySyncState::markSynced(const char *name, const Array *array)
+{
+  m_arrays[name] = {array, syncTime};
+}
+
+void GeometrySyncState::clear()
+{
+  m_arrays.clear();
+  numVertices = 0;
+  numPrimitives = 0;
+  vertexGather.clear();
+  primitiveGather.clear();
+  removedPrimitives = 0;
+  weldedVertices = 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -448,7 +1854,12 @@ void Sphere::setAttributes(ccl::PointCloud *pc) const
 
 Geometry::Geometry(CyclesGlobalState *s) : Object(ANARI_GEOMETRY, s) {}
 
-Geometry::~Geometry() = default;
+Geometry::~Geometry()
+{
+  for (auto *node : m_cyclesNodes)
+    deviceState()->deleteNodeDeferred(node);
+  releaseCombinedShader();
+}
 
 Geometry *Geometry::createInstance(std::string_view type, CyclesGlobalState *s)
 {
@@ -456,15 +1867,326 @@ Geometry *Geometry::createInstance(std::string_view type, CyclesGlobalState *s)
     return new Triangle(s);
   else if (type == "sphere")
     return new Sphere(s);
+  else if (type == "curve")
+    return new Curve(s, Curve::CURVE);
+  else if (type == "cylinder")
+    return new Curve(s, Curve::CYLINDER);
+  else if (type == "cone")
+    return new Curve(s, Curve::CONE);
+  else if (type == "isosurface")
+    return new Isosurface(s);
   else
     return (Geometry *)new UnknownObject(ANARI_GEOMETRY, type, s);
 }
 
+void Geometry::commitParameters()
+{
+  m_chunkSize = getParam<uint32_t>("chunkSize", 0u);
+}
+
 void Geometry::finalize()
 {
+  m_lastDataChange = helium::newTimeStamp();
   Object::finalize();
 }
 
+void Geometry::warnShortVertexArrays(const char *subtype,
+    size_t numVertices,
+    std::initializer_list<std::pair<const char *, const Array1D *>> arrays)
+{
+  for (const auto &[name, array] : arrays) {
+    if (array && array->size() < numVertices) {
+      reportMessage(ANARI_SEVERITY_WARNING,
+          "'%s' on %s geometry has fewer elements than 'vertex.position', "
+          "the missing values are read as zero",
+          name,
+          subtype);
+    }
+  }
+}
+
+helium::TimeStamp Geometry::lastDataChange() const
+{
+  return m_lastDataChange;
+}
+
+void Geometry::acquireCyclesNodes(Material *material)
+{
+  auto it = std::find_if(m_materialSlots.begin(),
+      m_materialSlots.end(),
+      [&](const MaterialSlot &s) { return s.material == material; });
+  if (it != m_materialSlots.end()) {
+    it->useCount++;
+    return;
+  }
+
+  m_materialSlots.push_back({material, 1});
+  updateCyclesShader();
+  if (m_materialSlots.size() > 1)
+    slotsChanged();
+}
+
+void Geometry::releaseCyclesNodes(const Material *material)
+{
+  auto it = std::find_if(m_materialSlots.begin(),
+      m_materialSlots.end(),
+      [&](const MaterialSlot &s) { return s.material == material; });
+  if (it == m_materialSlots.end() || --it->useCount > 0)
+    return;
+
+  m_materialSlots.erase(it);
+  if (!m_materialSlots.empty()) {
+    updateCyclesShader();
+    slotsChanged();
+    return;
+  }
+
+  // The last surface is gone
+  for (auto *node : m_cyclesNodes)
+    deviceState()->deleteNodeDeferred(node);
+  m_cyclesNodes.clear();
+  m_syncStates.clear();
+  m_lastSynced = 0;
+  releaseCombinedShader();
+  m_cyclesShader = nullptr;
+}
+
+void Geometry::updateCyclesNodes()
+{
+  if (m_materialSlots.empty())
+    return;
+
+  // Every surface sharing the nodes calls this, only the first one after a
+  // change does any work
+  if (!m_cyclesNodes.empty() && m_lastSynced >= lastDataChange())
+    return;
+
+  updateChunks();
+
+  // Chunks hold different primitives after a repartition, so every node is
+  // written from scratch
+  const size_t numNodes = numChunks();
+  const bool rewriteAll = m_lastSynced == 0 || m_lastSynced < m_lastChunking;
+  if (rewriteAll) {
+    for (size_t i = numNodes; i < m_cyclesNodes.size(); i++)
+      deviceState()->deleteNodeDeferred(m_cyclesNodes[i]);
+    m_cyclesNodes.resize(numNodes, nullptr);
+    for (auto &node : m_cyclesNodes) {
+      if (!node) {
+        node = createCyclesGeometryNode();
+        setCyclesNodeShader(node);
+      }
+    }
+    m_syncStates.clear();
+    m_syncStates.resize(numNodes);
+  }
+
+  // Chunks are converted concurrently, tagging touches the scene and is not
+  // thread safe so it happens afterwards
+  const bool chunked = m_chunkSizeInUse > 0;
+  std::vector<int> changes(numNodes, GEOMETRY_UNCHANGED);
+  for (auto &state : m_syncStates)
+    state.syncTime = helium::newTimeStamp();
+  tbb::parallel_for(size_t(0), numNodes, [&](size_t i) {
+    const auto c = chunk(i);
+    changes[i] = syncCyclesNode(
+        m_cyclesNodes[i], m_syncStates[i], chunked ? &c : nullptr);
+  });
+  m_lastSynced = helium::newTimeStamp();
+
+  // Attribute-only edits leave the BVH alone, moved vertices get a refit
+  size_t removedPrimitives = 0;
+  size_t weldedVertices = 0;
+  for (size_t i = 0; i < numNodes; i++) {
+    if (changes[i] != GEOMETRY_UNCHANGED || rewriteAll) {
+      m_cyclesNodes[i]->tag_update(
+          deviceState()->scene, (changes[i] & GEOMETRY_TOPOLOGY) != 0);
+    }
+    if (changes[i] & GEOMETRY_TOPOLOGY) {
+      removedPrimitives += m_syncStates[i].removedPrimitives;
+      weldedVertices += m_syncStates[i].weldedVertices;
+    }
+  }
+
+  if (removedPrimitives > 0 || weldedVertices > 0) {
+    reportMessage(ANARI_SEVERITY_INFO,
+        "anari_cycles::Geometry preprocessing removed %zu degenerate "
+        "primitives and welded %zu duplicate vertices",
+        removedPrimitives,
+        weldedVertices);
+  }
+}
+
+const std::vector<ccl::Geometry *> &Geometry::cyclesNodes() const
+{
+  return m_cyclesNodes;
+}
+
+uint32_t Geometry::cyclesMaterialSlot(const Material *material) const
+{
+  for (size_t i = 0; i < m_materialSlots.size(); i++) {
+    if (m_materialSlots[i].material == material)
+      return uint32_t(i);
+  }
+  return 0;
+}
+
+void Geometry::updateCyclesShader()
+{
+  std::vector<Material *> materials;
+  for (const auto &s : m_materialSlots)
+    materials.push_back(s.material);
+
+  ccl::Shader *shader = nullptr;
+  if (materials.size() == 1) {
+    releaseCombinedShader();
+    shader = materials[0]->cyclesShader();
+  } else if (materials.size() > 1) {
+    auto *scene = deviceState()->scene;
+    if (!m_combinedShader)
+      m_combinedShader = scene->create_node<ccl::Shader>();
+
+    if (materials != m_combinedMaterials) {
+      for (auto *m : m_combinedMaterials)
+        m->removeCombinedShaderUser(this);
+      for (auto *m : materials)
+        m->addCombinedShaderUser(this);
+      m_combinedMaterials = materials;
+    }
+
+    // Each material's closure is mixed in where the slot attribute names
+    // it, SVM skips the closures whose mix weight is zero. Objects without
+    // the attribute read slot 0, the first material.
+    auto graph = std::make_unique<ccl::ShaderGraph>();
+    auto *slot = graph->create_node<ccl::AttributeNode>();
+    slot->set_attribute(ccl::ustring(CYCLES_MATERIAL_SLOT_ATTRIBUTE));
+
+    ccl::ShaderOutput *closure = materials[0]->addCyclesClosure(graph.get());
+    for (size_t i = 1; i < materials.size(); i++) {
+      auto *materialClosure = materials[i]->addCyclesClosure(graph.get());
+
+      auto *isSlot = graph->create_node<ccl::MathNode>();
+      isSlot->set_math_type(ccl::NODE_MATH_COMPARE);
+      isSlot->set_value2(float(i));
+      isSlot->set_value3(0.5f);
+      graph->connect(slot->output("Fac"), isSlot->input("Value1"));
+
+      auto *mix = graph->create_node<ccl::MixClosureNode>();
+      graph->connect(isSlot->output("Value"), mix->input("Fac"));
+      if (closure)
+        graph->connect(closure, mix->input("Closure1"));
+      if (materialClosure)
+        graph->connect(materialClosure, mix->input("Closure2"));
+      closure = mix->output("Closure");
+    }
+    if (closure)
+      graph->connect(closure, graph->output()->input("Surface"));
+
+    m_combinedShader->set_graph(std::move(graph));
+    m_combinedShader->tag_update(scene);
+    shader = m_combinedShader;
+  }
+
+  if (shader == m_cyclesShader)
+    return;
+
+  m_cyclesShader = shader;
+  for (auto *node : m_cyclesNodes) {
+    setCyclesNodeShader(node);
+    node->tag_update(deviceState()->scene, false);
+  }
+}
+
+bool Geometry::canMergeIntoCyclesMesh() const
+{
+  return false;
+}
+
+size_t Geometry::numPrimitives() const
+{
+  return 0;
+}
+
+void Geometry::computePrimitiveCenters(float3 *) const
+{
+  // no-op
+}
+
+bool Geometry::syncTopology(GeometrySyncState &) const
+{
+  return false;
+}
+
+void Geometry::updateChunks()
+{
+  const size_t numPrims = numPrimitives();
+  const uint32_t chunkSize =
+      m_chunkSize > 0 && numPrims > m_chunkSize ? m_chunkSize : 0;
+
+  m_chunkTopology.syncTime = helium::newTimeStamp();
+  const bool topologyChanged = syncTopology(m_chunkTopology);
+  if (!topologyChanged && chunkSize == m_chunkSizeInUse)
+    return;
+
+  const bool wasChunked = m_chunkSizeInUse > 0;
+  m_chunkSizeInUse = chunkSize;
+  m_chunkOrder.clear();
+
+  if (chunkSize > 0) {
+    std::vector<float3> centers(numPrims);
+    computePrimitiveCenters(centers.data());
+    m_chunkOrder = mortonOrder(centers.data(), numPrims);
+    reportMessage(ANARI_SEVERITY_DEBUG,
+        "anari_cycles::Geometry split %zu primitives into %zu chunks",
+        numPrims,
+        numChunks());
+  }
+
+  if (chunkSize > 0 || wasChunked)
+    m_lastChunking = helium::newTimeStamp();
+}
+
+size_t Geometry::numChunks() const
+{
+  if (m_chunkSizeInUse == 0)
+    return 1;
+  return (m_chunkOrder.size() + m_chunkSizeInUse - 1) / m_chunkSizeInUse;
+}
+
+GeometryChunk Geometry::chunk(size_t i) const
+{
+  if (m_chunkSizeInUse == 0)
+    return {};
+  const size_t begin = i * m_chunkSizeInUse;
+  const size_t end = std::min(begin + m_chunkSizeInUse, m_chunkOrder.size());
+  return {m_chunkOrder.data() + begin, end - begin};
+}
+
+void Geometry::setCyclesNodeShader(ccl::Geometry *node)
+{
+  ccl::array<ccl::Node *> used_shaders;
+  used_shaders.push_back_slow(m_cyclesShader);
+  node->set_used_shaders(used_shaders);
+}
+
+void Geometry::slotsChanged()
+{
+  // Instances write each object's slot when the world syncs
+  deviceState()->objectUpdates.lastSceneChange = helium::newTimeStamp();
+}
+
+void Geometry::releaseCombinedShader()
+{
+  for (auto *m : m_combinedMaterials)
+    m->removeCombinedShaderUser(this);
+  m_combinedMaterials.clear();
+
+  if (m_combinedShader) {
+    deviceState()->deleteNodeDeferred(m_combinedShader);
+    m_combinedShader = nullptr;
+  }
+}
+
 } // namespace anari_cycles
 
 CYCLES_ANARI_TYPEFOR_DEFINITION(anari_cycles::Geometry *);
@@ -7,9 +7,70 @@
 #include "Object.h"
 // cycles
 #include "scene/geometry.h"
+// std
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace anari_cycles {
 
+struct Material;
+
+// Object attribute holding the material slot, see acquireCyclesNodes()
+constexpr const char *CYCLES_MATERIAL_SLOT_ATTRIBUTE = "anari_material";
+
+// What a call to Geometry::syncCyclesNode() rewrote on the Cycles node
+enum GeometryChange
+{
+  GEOMETRY_UNCHANGED = 0,
+  GEOMETRY_ATTRIBUTES = 1 << 0, // shading data only, the BVH is untouched
+  GEOMETRY_POSITIONS = 1 << 1, // vertex data moved, the BVH can be refit
+  GEOMETRY_TOPOLOGY = 1 << 2 // primitives changed, the BVH must be rebuilt
+};
+
+// Remembers which version of each input array was last written to a Cycles
+// geometry node, letting a sync tell which inputs changed since then
+struct GeometrySyncState
+{
+  bool changed(const char *name, const Array *array) const;
+  bool changed(const char *name, helium::TimeStamp lastModified) const;
+  void markSynced(const char *name, const Array *array = nullptr);
+  void clear();
+
+  // Stamp markSynced() records, taken once before a sync so that several
+  // nodes can be synced concurrently
+  helium::TimeStamp syncTime{0};
+
+  size_t numVertices{0};
+  size_t numPrimitives{0};
+  // Vertices of the full geometry a node holds, in node order, when it
+  // doesn't hold all of them (chunks and preprocessed meshes)
+  std::vector<uint32_t> vertexGather;
+  // Same for the primitives of the full geometry
+  std::vector<uint32_t> primitiveGather;
+  // What preprocessing removed when the node's topology was last written
+  size_t removedPrimitives{0};
+  size_t weldedVertices{0};
+
+ private:
+  struct SyncedArray
+  {
+    const Array *array{nullptr};
+    helium::TimeStamp lastSynced{0};
+  };
+
+  std::map<std::string, SyncedArray> m_arrays;
+};
+
+// Primitives of a geometry split into chunks which one Cycles node holds
+struct GeometryChunk
+{
+  const uint32_t *primitives{nullptr};
+  size_t numPrimitives{0};
+};
+
 struct Geometry : public Object
 {
   Geometry(CyclesGlobalState *s);
@@ -18,10 +79,86 @@ struct Geometry : public Object
   static Geometry *createInstance(
       std::string_view type, CyclesGlobalState *state);
 
+  virtual void commitParameters() override;
   virtual void finalize() override;
 
+  // When the geometry's parameters or observed arrays last changed
+  helium::TimeStamp lastDataChange() const;
+
+  // Cycles nodes are owned by the geometry and shared by every surface using
+  // it, whatever its material. There is one node per chunk, which is a
+  // single node unless 'chunkSize' splits the geometry.
+  //
+  // Cycles binds shaders to the geometry node, not the object. While all
+  // surfaces use one material the nodes get its shader, otherwise they get a
+  // shader combining every material in use which picks one per object from
+  // the CYCLES_MATERIAL_SLOT_ATTRIBUTE object attribute.
+  void acquireCyclesNodes(Material *material);
+  void releaseCyclesNodes(const Material *material);
+  // Write any data changed since the nodes were last synced
+  void updateCyclesNodes();
+  const std::vector<ccl::Geometry *> &cyclesNodes() const;
+  // Value of the slot attribute which selects 'material' on the nodes,
+  // objects without the attribute get slot 0. Slot changes resync the world.
+  uint32_t cyclesMaterialSlot(const Material *material) const;
+  // Rebind the nodes' shader, rebuilding the combined one if there is one
+  void updateCyclesShader();
+
+  // Whether syncCyclesNode() can write into a plain ccl::Mesh, which lets
+  // groups merge the geometry with others into one multi-shader mesh
+  virtual bool canMergeIntoCyclesMesh() const;
+
   virtual ccl::Geometry *createCyclesGeometryNode() = 0;
-  virtual void syncCyclesNode(ccl::Geometry *node) const = 0;
+  // Writes the whole geometry, or only 'chunk' if given, to the node and
+  // returns a mask of GeometryChange values
+  virtual int syncCyclesNode(ccl::Geometry *node,
+      GeometrySyncState &state,
+      const GeometryChunk *chunk) const = 0;
+
+ protected:
+  // Primitive count and centers used to split the geometry into chunks,
+  // geometries which don't provide them are never split
+  virtual size_t numPrimitives() const;
+  virtual void computePrimitiveCenters(float3 *centers) const;
+  // Whether the set of primitives changed since 'state' last saw it
+  virtual bool syncTopology(GeometrySyncState &state) const;
+  // Warns about named per-vertex arrays with fewer than 'numVertices'
+  // elements, their gathered reads past the end come back as zero
+  void warnShortVertexArrays(const char *subtype,
+      size_t numVertices,
+      std::initializer_list<std::pair<const char *, const Array1D *>> arrays);
+
+ private:
+  // A material used with the nodes, kept alive by the surfaces using it
+  struct MaterialSlot
+  {
+    Material *material{nullptr};
+    size_t useCount{0};
+  };
+
+  void updateChunks();
+  size_t numChunks() const;
+  GeometryChunk chunk(size_t i) const;
+  void setCyclesNodeShader(ccl::Geometry *node);
+  void slotsChanged();
+  void releaseCombinedShader();
+
+  std::vector<ccl::Geometry *> m_cyclesNodes; // one per chunk
+  std::vector<GeometrySyncState> m_syncStates;
+  helium::TimeStamp m_lastSynced{0};
+  std::vector<MaterialSlot> m_materialSlots;
+  ccl::Shader *m_cyclesShader{nullptr}; // bound to the nodes
+  ccl::Shader *m_combinedShader{nullptr};
+  // Materials m_combinedShader was built from, each registered as its user
+  std::vector<Material *> m_combinedMaterials;
+  helium::TimeStamp m_lastDataChange{0};
+
+  // Primitives in Morton order, split into ranges of m_chunkSizeInUse
+  uint32_t m_chunkSize{0};
+  uint32_t m_chunkSizeInUse{0};
+  std::vector<uint32_t> m_chunkOrder;
+  GeometrySyncState m_chunkTopology;
+  helium::TimeStamp m_lastChunking{0};
 };
 
 } // namespace anari_cycles
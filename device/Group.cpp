@@ -3,10 +3,121 @@
 
 #include "Group.h"
 // cycles
-#include "scene/object.h"
+#include "util/color.h"
+#include "util/tbb.h"
+// std
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace anari_cycles {
 
+// Helper functions ///////////////////////////////////////////////////////////
+
+// Float components per element a part's attribute needs in the merged mesh
+static int mergedComponents(const ccl::Attribute &attr)
+{
+  if (attr.element == ATTR_ELEMENT_CORNER_BYTE)
+    return 4;
+  return int(attr.type.aggregate);
+}
+
+static ccl::TypeDesc mergedType(int components)
+{
+  switch (components) {
+  case 1:
+    return ccl::TypeFloat;
+  case 2:
+    return ccl::TypeFloat2;
+  case 3:
+    return ccl::TypeColor;
+  default:
+    return ccl::TypeFloat4;
+  }
+}
+
+// Element a part's attribute is merged as, byte corners are plain corners
+static ccl::AttributeElement mergedElement(const ccl::Attribute &attr)
+{
+  if (attr.element == ATTR_ELEMENT_CORNER_BYTE)
+    return ATTR_ELEMENT_CORNER;
+  return attr.element;
+}
+
+// Number of elements 'element' has in a part
+static size_t elementCount(
+    const ccl::Mesh &part, ccl::AttributeElement element)
+{
+  switch (element) {
+  case ATTR_ELEMENT_FACE:
+    return part.num_triangles();
+  case ATTR_ELEMENT_CORNER:
+    return part.num_triangles() * 3;
+  default:
+    return part.get_verts().size();
+  }
+}
+
+// Writes a part's attribute into the merged attribute starting at element
+// 'offset', widening or narrowing each element to the merged type. Merged
+// corner attributes read per-vertex and per-face parts through the part's
+// triangles, so parts may disagree on where their data lives.
+static void copyMergedAttribute(const ccl::Attribute &src,
+    ccl::Attribute &dst,
+    const ccl::Mesh &part,
+    size_t offset)
+{
+  const ccl::AttributeElement srcElement = mergedElement(src);
+  const size_t count = elementCount(part, dst.element);
+  const size_t srcCount = src.buffer.size() / src.data_sizeof();
+  const size_t dstStride = dst.data_sizeof() / sizeof(float);
+  const int dstComponents = int(dst.type.aggregate);
+  auto *out = (float *)dst.data() + offset * dstStride;
+  const auto &triangles = part.get_triangles();
+
+  auto sourceIndex = [&](size_t i) -> size_t {
+    if (dst.element != ATTR_ELEMENT_CORNER || srcElement == ATTR_ELEMENT_CORNER)
+      return i;
+    return srcElement == ATTR_ELEMENT_FACE ? i / 3 : size_t(triangles[i]);
+  };
+
+  auto copy = [&](auto read) {
+    for (size_t i = 0; i < count; i++) {
+      const size_t s = sourceIndex(i);
+      if (s >= srcCount)
+        continue;
+      float v[4] = {0.f, 0.f, 0.f, 1.f};
+      read(s, v);
+      std::copy(v, v + dstComponents, out + i * dstStride);
+    }
+  };
+
+  if (src.element == ATTR_ELEMENT_CORNER_BYTE) {
+    const auto *in = src.data_uchar4();
+    copy([&](size_t s, float *v) {
+      const auto c = ccl::color_srgb_to_linear_v4(
+          ccl::color_uchar4_to_float4(in[s]));
+      v[0] = c.x;
+      v[1] = c.y;
+      v[2] = c.z;
+      v[3] = c.w;
+    });
+    return;
+  }
+
+  const size_t srcStride = src.data_sizeof() / sizeof(float);
+  const int srcComponents = int(src.type.aggregate);
+  const auto *in = (const float *)src.data();
+  copy([&](size_t s, float *v) {
+    std::copy(in + s * srcStride, in + s * srcStride + srcComponents, v);
+  });
+}
+
+// Group definitions //////////////////////////////////////////////////////////
+
 Group::Group(CyclesGlobalState *s)
     : Object(ANARI_GROUP, s),
       m_surfaceData(this),
@@ -14,21 +125,34 @@ Group::Group(CyclesGlobalState *s)
       m_lightData(this)
 {}
 
-Group::~Group() = default;
+Group::~Group()
+{
+  releaseMergedCyclesMesh();
+}
 
 void Group::commitParameters()
 {
   m_surfaceData = getParamObject<ObjectArray>("surface");
   m_volumeData = getParamObject<ObjectArray>("volume");
   m_lightData = getParamObject<ObjectArray>("light");
+  m_mergeSurfaces = getParam<bool>("mergeSurfaces", false);
+  m_lastChange = helium::newTimeStamp();
 }
 
-void Group::addGroupToCurrentCyclesScene(const math::mat4 &xfm) const
+void Group::finalize()
 {
-  auto &state = *deviceState();
+  // Also reached when an observed array's contents changed
+  m_lastChange = helium::newTimeStamp();
+  Object::finalize();
+}
 
-  auto cxfm = mat4ToCycles(xfm);
+helium::TimeStamp Group::lastChange() const
+{
+  return m_lastChange;
+}
 
+void Group::gatherCyclesItems(std::vector<CyclesItem> &items) const
+{
   if (m_surfaceData) {
     auto **surfacesBegin = (Surface **)m_surfaceData->handlesBegin();
     auto **surfacesEnd = (Surface **)m_surfaceData->handlesEnd();
@@ -38,13 +162,16 @@ void Group::addGroupToCurrentCyclesScene(const math::mat4 &xfm) const
         s->warnIfUnknownObject();
         return;
       }
-      auto *o = state.scene->create_node<ccl::Object>();
-      o->set_geometry(s->cyclesGeometry());
-      o->set_tfm(cxfm);
+      if (isMergedSurface(s))
+        return;
+      for (auto *g : s->cyclesGeometries())
+        items.push_back({s, g, s->cyclesMaterialSlot()});
     });
   }
 
-#if 0
+  if (m_mergedMesh)
+    items.push_back({this, m_mergedMesh});
+
   if (m_volumeData) {
     auto **volumesBegin = (Volume **)m_volumeData->handlesBegin();
     auto **volumesEnd = (Volume **)m_volumeData->handlesEnd();
@@ -54,12 +181,10 @@ void Group::addGroupToCurrentCyclesScene(const math::mat4 &xfm) const
         v->warnIfUnknownObject();
         return;
       }
-      auto *o = state.scene->create_node<ccl::Object>();
-      o->set_geometry(v->cyclesGeometry());
-      o->set_tfm(xfm);
+      if (auto *g = v->cyclesGeometry(); g)
+        items.push_back({v, g});
     });
   }
-#endif
 
   if (m_lightData) {
     auto **lightsBegin = (Light **)m_lightData->handlesBegin();
@@ -70,11 +195,266 @@ void Group::addGroupToCurrentCyclesScene(const math::mat4 &xfm) const
         l->warnIfUnknownObject();
         return;
       }
-      auto *o = state.scene->create_node<ccl::Object>();
-      o->set_geometry(l->cyclesLight());
-      o->set_tfm(mat4ToCycles(math::mul(xfm, l->xfm())));
+      items.push_back({l, l->cyclesLight(), 0, l});
+    });
+  }
+}
+
+void Group::gatherSurfaces(std::vector<Surface *> &surfaces) const
+{
+  if (!m_surfaceData)
+    return;
+
+  auto **surfacesBegin = (Surface **)m_surfaceData->handlesBegin();
+  auto **surfacesEnd = (Surface **)m_surfaceData->handlesEnd();
+  std::copy_if(surfacesBegin,
+      surfacesEnd,
+      std::back_inserter(surfaces),
+      [&](Surface *s) { return s != nullptr && !isMergedSurface(s); });
+}
+
+void Group::gatherVolumes(std::vector<Volume *> &volumes) const
+{
+  if (!m_volumeData)
+    return;
+
+  auto **volumesBegin = (Volume **)m_volumeData->handlesBegin();
+  auto **volumesEnd = (Volume **)m_volumeData->handlesEnd();
+  std::copy_if(volumesBegin,
+      volumesEnd,
+      std::back_inserter(volumes),
+      [](Volume *v) { return v != nullptr; });
+}
+
+void Group::retainCyclesResidency()
+{
+  m_residencyCount++;
+}
+
+void Group::releaseCyclesResidency()
+{
+  if (m_residencyCount == 0 || --m_residencyCount > 0)
+    return;
+  releaseMergedCyclesMesh();
+}
+
+void Group::updateMergedCyclesMesh()
+{
+  std::vector<Surface *> surfaces;
+  if (m_residencyCount > 0 && m_surfaceData) {
+    auto **surfacesBegin = (Surface **)m_surfaceData->handlesBegin();
+    auto **surfacesEnd = (Surface **)m_surfaceData->handlesEnd();
+    std::copy_if(surfacesBegin,
+        surfacesEnd,
+        std::back_inserter(surfaces),
+        [&](Surface *s) { return isMergedSurface(s); });
+  }
+
+  if (surfaces.empty()) {
+    releaseMergedCyclesMesh();
+    return;
+  }
+
+  const bool upToDate = m_mergedMesh
+      && std::equal(surfaces.begin(),
+          surfaces.end(),
+          m_mergedSurfaces.begin(),
+          m_mergedSurfaces.end(),
+          [&](const Surface *s, const helium::IntrusivePtr<Surface> &m) {
+            return s == m.ptr && s->lastChange() < m_lastMerge;
+          });
+  if (upToDate)
+    return;
+
+  // Take the new mesh's references before dropping the previous ones, so
+  // shaders used by both stay resident
+  std::vector<helium::IntrusivePtr<Material>> materials;
+  std::unordered_set<const Material *> seenMaterials;
+  for (auto *s : surfaces) {
+    s->retainMergedUse();
+    if (seenMaterials.insert(s->material()).second) {
+      s->material()->retainCyclesShader();
+      materials.emplace_back(s->material());
+    }
+  }
+
+  for (auto &s : m_mergedSurfaces)
+    s->releaseMergedUse();
+  for (auto &m : m_mergedMaterials)
+    m->releaseCyclesShader();
+
+  m_mergedSurfaces.assign(surfaces.begin(), surfaces.end());
+  m_mergedMaterials = std::move(materials);
+
+  buildMergedCyclesMesh();
+  m_lastMerge = helium::newTimeStamp();
+}
+
+bool Group::isMergedSurface(const Surface *s) const
+{
+  return m_mergeSurfaces && s && s->isValid()
+      && s->geometry()->canMergeIntoCyclesMesh();
+}
+
+void Group::buildMergedCyclesMesh()
+{
+  auto *scene = deviceState()->scene;
+  if (!m_mergedMesh)
+    m_mergedMesh = scene->create_node<ccl::Mesh>();
+
+  // Each material gets a shader slot, addressed by the per-triangle shader
+  // index of the merged mesh
+  std::unordered_map<const Material *, int> shaderSlots;
+  ccl::array<ccl::Node *> usedShaders;
+  for (auto &m : m_mergedMaterials) {
+    shaderSlots[m.ptr] = int(usedShaders.size());
+    usedShaders.push_back_slow(m->cyclesShader());
+  }
+
+  // Convert every part with the same code unmerged surfaces use, into
+  // standalone meshes which never enter the Cycles scene
+  const size_t numParts = m_mergedSurfaces.size();
+  const auto syncTime = helium::newTimeStamp();
+  std::vector<std::unique_ptr<ccl::Mesh>> parts(numParts);
+  tbb::parallel_for(size_t(0), numParts, [&](size_t i) {
+    GeometrySyncState state;
+    state.syncTime = syncTime;
+    parts[i] = std::make_unique<ccl::Mesh>();
+    m_mergedSurfaces[i]->geometry()->syncCyclesNode(
+        parts[i].get(), state, nullptr);
+  });
+
+  std::vector<size_t> vertexOffset(numParts + 1, 0);
+  std::vector<size_t> triangleOffset(numParts + 1, 0);
+  bool hasNormals = false;
+  struct MergedAttribute
+  {
+    int components{1};
+    ccl::AttributeElement element{ATTR_ELEMENT_NONE};
+    ccl::AttributeStandard std{ATTR_STD_NONE};
+  };
+  std::map<ccl::ustring, MergedAttribute> mergedAttributes;
+
+  for (size_t i = 0; i < numParts; i++) {
+    const auto &part = *parts[i];
+    vertexOffset[i + 1] = vertexOffset[i] + part.get_verts().size();
+    triangleOffset[i + 1] = triangleOffset[i] + part.num_triangles();
+    for (const auto &a : part.attributes.attributes) {
+      if (a.std == ATTR_STD_VERTEX_NORMAL) {
+        hasNormals = true;
+        continue;
+      }
+      auto &m = mergedAttributes[a.name];
+      m.components = std::max(m.components, mergedComponents(a));
+      // Parts which disagree on the element all get promoted to corners
+      const auto element = mergedElement(a);
+      if (m.element == ATTR_ELEMENT_NONE)
+        m.element = element;
+      else if (m.element != element)
+        m.element = ATTR_ELEMENT_CORNER;
+      m.std = a.std;
+    }
+  }
+
+  // Once any part brings its own normals every part needs them, so fill in
+  // the ones Cycles would otherwise have generated at render time
+  if (hasNormals) {
+    tbb::parallel_for(size_t(0), numParts, [&](size_t i) {
+      parts[i]->add_vertex_normals();
+    });
+  }
+
+  const size_t numVertices = vertexOffset[numParts];
+  const size_t numTriangles = triangleOffset[numParts];
+
+  ccl::array<ccl::float3> verts;
+  ccl::array<int> triangles;
+  ccl::array<int> shader;
+  ccl::array<bool> smooth;
+  auto *dstVerts = verts.resize(numVertices);
+  auto *dstTriangles = triangles.resize(numTriangles * 3);
+  auto *dstShader = shader.resize(numTriangles);
+  auto *dstSmooth = smooth.resize(numTriangles);
+
+  tbb::parallel_for(size_t(0), numParts, [&](size_t i) {
+    const auto &part = *parts[i];
+    const auto &partVerts = part.get_verts();
+    const auto &partTriangles = part.get_triangles();
+    const auto &partSmooth = part.get_smooth();
+    const int base = int(vertexOffset[i]);
+    const size_t t0 = triangleOffset[i];
+    const size_t nt = triangleOffset[i + 1] - t0;
+
+    std::copy_n(partVerts.data(), partVerts.size(), dstVerts + base);
+    std::transform(partTriangles.data(),
+        partTriangles.data() + nt * 3,
+        dstTriangles + t0 * 3,
+        [&](int v) { return v + base; });
+    std::fill_n(dstShader + t0,
+        nt,
+        shaderSlots.at(m_mergedSurfaces[i]->material()));
+    std::copy_n(partSmooth.data(), nt, dstSmooth + t0);
+  });
+
+  m_mergedMesh->set_verts(verts);
+  m_mergedMesh->set_triangles(triangles);
+  m_mergedMesh->set_shader(shader);
+  m_mergedMesh->set_smooth(smooth);
+  m_mergedMesh->set_used_shaders(usedShaders);
+
+  // Attribute storage is sized from the element counts set above, parts
+  // missing an attribute keep the zeros it was allocated with
+  auto &attributes = m_mergedMesh->attributes;
+  attributes.clear();
+
+  auto copyParts = [&](ccl::Attribute *dst, auto findInPart) {
+    tbb::parallel_for(size_t(0), numParts, [&](size_t i) {
+      const ccl::Attribute *src = findInPart(*parts[i]);
+      if (!src)
+        return;
+      size_t offset = vertexOffset[i];
+      if (dst->element == ATTR_ELEMENT_FACE)
+        offset = triangleOffset[i];
+      else if (dst->element == ATTR_ELEMENT_CORNER)
+        offset = triangleOffset[i] * 3;
+      copyMergedAttribute(*src, *dst, *parts[i], offset);
+    });
+  };
+
+  if (hasNormals) {
+    copyParts(attributes.add(ATTR_STD_VERTEX_NORMAL), [](ccl::Mesh &part) {
+      return part.attributes.find(ATTR_STD_VERTEX_NORMAL);
+    });
+  }
+
+  for (const auto &[name, m] : mergedAttributes) {
+    ccl::Attribute *attr =
+        attributes.add(name, mergedType(m.components), m.element);
+    attr->std = m.std;
+    copyParts(attr, [&name = name](ccl::Mesh &part) {
+      return part.attributes.find(name);
     });
   }
+
+  m_mergedMesh->tag_update(scene, true);
+
+  reportMessage(ANARI_SEVERITY_DEBUG,
+      "anari_cycles::Group merged %zu surfaces into one mesh (%zu triangles)",
+      numParts,
+      numTriangles);
+}
+
+void Group::releaseMergedCyclesMesh()
+{
+  deviceState()->deleteNodeDeferred(m_mergedMesh);
+  m_mergedMesh = nullptr;
+
+  for (auto &s : m_mergedSurfaces)
+    s->releaseMergedUse();
+  for (auto &m : m_mergedMaterials)
+    m->releaseCyclesShader();
+  m_mergedSurfaces.clear();
+  m_mergedMaterials.clear();
 }
 
 box3 Group::bounds() const
@@ -6,17 +6,49 @@
 #include "Light.h"
 #include "Surface.h"
 #include "Volume.h"
+// cycles
+#include "scene/mesh.h"
+// std
+#include <vector>
 
 namespace anari_cycles {
 
 struct Group : public Object
 {
+  // A Cycles geometry node (from a surface or light) which gets one
+  // ccl::Object per transform of each instance referencing the group
+  struct CyclesItem
+  {
+    const Object *object{nullptr};
+    ccl::Geometry *geometry{nullptr};
+    uint32_t materialSlot{0}; // see Geometry::cyclesMaterialSlot()
+    // Set if the item carries a light transform, the reference keeps the
+    // light readable until the instance resyncs even if the group drops it
+    helium::IntrusivePtr<Light> light;
+  };
+
   Group(CyclesGlobalState *s);
   ~Group() override;
 
   void commitParameters() override;
+  void finalize() override;
+
+  // When the group's parameters or arrays last changed, items gathered
+  // before then may point at objects the group no longer holds
+  helium::TimeStamp lastChange() const;
+
+  void gatherCyclesItems(std::vector<CyclesItem> &items) const;
+  // Surfaces which need Cycles nodes of their own, merged ones are left out
+  void gatherSurfaces(std::vector<Surface *> &surfaces) const;
+  void gatherVolumes(std::vector<Volume *> &volumes) const;
 
-  void addGroupToCurrentCyclesScene(const math::mat4 &xfm) const;
+  // With 'mergeSurfaces' set, the group bakes its triangle surfaces into one
+  // multi-shader mesh while it is reachable from the rendered world, so each
+  // instance transform places a single object for all of them
+  void retainCyclesResidency();
+  void releaseCyclesResidency();
+  // Rebuild the merged mesh if its surfaces changed since the last build
+  void updateMergedCyclesMesh();
 
   box3 bounds() const override;
 
@@ -27,6 +59,21 @@ struct Group : public Object
   helium::ChangeObserverPtr<ObjectArray> m_surfaceData;
   helium::ChangeObserverPtr<ObjectArray> m_volumeData;
   helium::ChangeObserverPtr<ObjectArray> m_lightData;
+
+  bool isMergedSurface(const Surface *s) const;
+  void buildMergedCyclesMesh();
+  void releaseMergedCyclesMesh();
+
+  helium::TimeStamp m_lastChange{0};
+  bool m_mergeSurfaces{false};
+  size_t m_residencyCount{0};
+
+  ccl::Mesh *m_mergedMesh{nullptr};
+  // Surfaces baked into the merged mesh and the materials of its shaders,
+  // each holding a merged use or shader residency reference respectively
+  std::vector<helium::IntrusivePtr<Surface>> m_mergedSurfaces;
+  std::vector<helium::IntrusivePtr<Material>> m_mergedMaterials;
+  helium::TimeStamp m_lastMerge{0};
 };
 
 } // namespace anari_cycles
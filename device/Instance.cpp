@@ -2,22 +2,79 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "Instance.h"
+#include "array_conversion.h"
+// cycles
+#include "scene/scene.h"
 // std
+#include <algorithm>
 #include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <unordered_map>
 
 namespace anari_cycles {
 
 Instance::Instance(CyclesGlobalState *s)
-    : Object(ANARI_INSTANCE, s), m_xfmArray(this)
-{}
+    : Object(ANARI_INSTANCE, s),
+      m_xfmArray(this),
+      m_xfmRotation(this),
+      m_xfmTranslation(this),
+      m_xfmScale(this),
+      m_color(this),
+      m_attribute0(this),
+      m_attribute1(this),
+      m_attribute2(this),
+      m_attribute3(this)
+{
+  m_attributes[0] = {"color", &m_color};
+  m_attributes[1] = {"attribute0", &m_attribute0};
+  m_attributes[2] = {"attribute1", &m_attribute1};
+  m_attributes[3] = {"attribute2", &m_attribute2};
+  m_attributes[4] = {"attribute3", &m_attribute3};
+}
 
-Instance::~Instance() = default;
+Instance::~Instance()
+{
+  releaseCyclesObjects();
+}
 
 void Instance::commitParameters()
 {
   m_group = getParamObject<Group>("group");
   m_xfmArray = getParamObject<Array1D>("transform");
+  m_xfmRotation = getParamObject<Array1D>("transform.rotation");
+  m_xfmTranslation = getParamObject<Array1D>("transform.translation");
+  m_xfmScale = getParamObject<Array1D>("transform.scale");
   m_xfm = getParam<helium::mat4>("transform", linalg::identity);
+  updateTransformFormat();
+
+  for (auto &a : m_attributes) {
+    *a.array = getParamObject<Array1D>(a.name);
+    a.value.reset();
+    if (*a.array)
+      continue;
+    const auto &v = getParamDirect(a.name);
+    if (v.valid() && !anari::isObject(v.type()) && v.type() != ANARI_STRING)
+      a.value = convertValue<float4>(v.type(), v.data());
+  }
+}
+
+void Instance::finalize()
+{
+  if (canUpdateTransformsInPlace())
+    updateCyclesTransforms();
+
+  Object::finalize();
+}
+
+void Instance::markFinalized()
+{
+  // Transform-only changes were already applied to the existing Cycles
+  // objects in finalize(), so they don't require the world to be resynced
+  if (canUpdateTransformsInPlace())
+    helium::BaseObject::markFinalized();
+  else
+    Object::markFinalized();
 }
 
 Group *Instance::group() const
@@ -25,20 +82,77 @@ Group *Instance::group() const
   return m_group.ptr;
 }
 
-void Instance::addInstanceObjectsToCyclesScene()
+void Instance::syncCyclesObjects()
 {
-  if (!isValid())
-    return;
+  auto *scene = deviceState()->scene;
+
+  std::vector<Group::CyclesItem> items;
+  if (isValid())
+    m_group->gatherCyclesItems(items);
+
+  const size_t numXfms = items.empty() ? 0 : numTransforms();
+  const size_t numItems = items.size();
+  const size_t prevNumItems = m_cyclesItems.size();
+  const size_t prevNumXfms =
+      prevNumItems ? m_cyclesObjects.size() / prevNumItems : 0;
+
+  // Match each item to a column its object previously occupied, if any,
+  // objects with several items (chunked geometry) have several columns
+  constexpr size_t NO_COLUMN = std::numeric_limits<size_t>::max();
+  std::unordered_multimap<const Object *, size_t> prevColumns;
+  for (size_t k = 0; k < prevNumItems; k++)
+    prevColumns.emplace(m_cyclesItems[k].object, k);
 
-  if (!m_xfmArray)
-    m_group->addGroupToCurrentCyclesScene(m_xfm);
-  else {
-    auto *begin = m_xfmArray->beginAs<helium::mat4>();
-    auto *end = m_xfmArray->endAs<helium::mat4>();
-    std::for_each(begin, end, [&](const helium::mat4 &m) {
-      m_group->addGroupToCurrentCyclesScene(m);
-    });
+  std::vector<size_t> prevColumn(numItems, NO_COLUMN);
+  for (size_t j = 0; j < numItems; j++) {
+    if (auto it = prevColumns.find(items[j].object); it != prevColumns.end()) {
+      prevColumn[j] = it->second;
+      prevColumns.erase(it);
+    }
   }
+
+  // Node creation and geometry assignment (which reference counts the shared
+  // geometry node) aren't thread safe, so claim objects serially...
+  std::vector<ccl::Object *> objects(numXfms * numItems, nullptr);
+  for (size_t i = 0; i < numXfms; i++) {
+    for (size_t j = 0; j < numItems; j++) {
+      ccl::Object *o = nullptr;
+      if (i < prevNumXfms && prevColumn[j] != NO_COLUMN)
+        std::swap(o, m_cyclesObjects[i * prevNumItems + prevColumn[j]]);
+      else
+        o = scene->create_node<ccl::Object>();
+      o->set_geometry(items[j].geometry);
+      objects[i * numItems + j] = o;
+    }
+  }
+
+  // Anything not claimed above no longer exists in the instance
+  for (auto *o : m_cyclesObjects)
+    deviceState()->deleteNodeDeferred(o);
+
+  m_cyclesItems = std::move(items);
+  m_cyclesObjects = std::move(objects);
+
+  // ...then convert and write the transforms in parallel
+  writeCyclesTransforms(false);
+  writeCyclesAttributes();
+  tagModifiedObjects();
+
+  m_syncedGroup = m_cyclesItems.empty() ? nullptr : m_group.ptr;
+  m_lastSync = helium::newTimeStamp();
+}
+
+void Instance::releaseCyclesObjects()
+{
+  if (m_cyclesObjects.empty())
+    return;
+
+  for (auto *o : m_cyclesObjects)
+    deviceState()->deleteNodeDeferred(o);
+
+  m_cyclesItems.clear();
+  m_cyclesObjects.clear();
+  m_syncedGroup = nullptr;
 }
 
 box3 Instance::bounds() const
@@ -77,13 +191,8 @@ box3 Instance::bounds() const
             &xfm, make_float3(gb.upper.x, gb.lower.y, gb.upper.z)));
   };
 
-  if (!m_xfmArray)
-    extendBounds(m_xfm);
-  else {
-    auto *begin = m_xfmArray->beginAs<helium::mat4>();
-    auto *end = m_xfmArray->endAs<helium::mat4>();
-    std::for_each(begin, end, [&](const helium::mat4 &m) { extendBounds(m); });
-  }
+  for (size_t i = 0; i < numTransforms(); i++)
+    extendBounds(transform(i));
 
   return b;
 }
@@ -93,6 +202,329 @@ bool Instance::isValid() const
   return m_group;
 }
 
+void Instance::updateTransformFormat()
+{
+  m_xfmFormat = XFM_SINGLE;
+
+  if (m_xfmArray) {
+    switch (m_xfmArray->elementType()) {
+    case ANARI_FLOAT32_MAT4:
+      m_xfmFormat = XFM_MAT4;
+      break;
+    case ANARI_FLOAT32_MAT3x4:
+      m_xfmFormat = XFM_MAT3x4;
+      break;
+    case ANARI_FLOAT32_VEC3:
+      m_xfmFormat = XFM_TRANSLATION;
+      break;
+    case ANARI_FLOAT32_VEC4:
+      m_xfmFormat = XFM_TRANSLATION_SCALE;
+      break;
+    default:
+      reportMessage(ANARI_SEVERITY_WARNING,
+          "unsupported element type %s for instance 'transform' array",
+          anari::toString(m_xfmArray->elementType()));
+      break;
+    }
+    return;
+  }
+
+  auto checkType = [&](helium::ChangeObserverPtr<Array1D> &array,
+                       const char *name,
+                       std::initializer_list<anari::DataType> types) {
+    if (!array)
+      return;
+    const auto type = array->elementType();
+    if (std::find(types.begin(), types.end(), type) == types.end()) {
+      reportMessage(ANARI_SEVERITY_WARNING,
+          "unsupported element type %s for instance '%s' array",
+          anari::toString(type),
+          name);
+      array = nullptr;
+    }
+  };
+
+  checkType(m_xfmRotation,
+      "transform.rotation",
+      {ANARI_FLOAT32_QUAT_IJKW, ANARI_FLOAT32_VEC4});
+  checkType(m_xfmTranslation, "transform.translation", {ANARI_FLOAT32_VEC3});
+  checkType(
+      m_xfmScale, "transform.scale", {ANARI_FLOAT32, ANARI_FLOAT32_VEC3});
+
+  if (m_xfmRotation || m_xfmTranslation || m_xfmScale)
+    m_xfmFormat = XFM_TRS;
+}
+
+size_t Instance::numTransforms() const
+{
+  switch (m_xfmFormat) {
+  case XFM_SINGLE:
+    return 1;
+  case XFM_TRS: {
+    size_t n = 0;
+    for (const auto *a :
+        {m_xfmRotation.get(), m_xfmTranslation.get(), m_xfmScale.get()}) {
+      if (a)
+        n = std::max(n, a->size());
+    }
+    return n;
+  }
+  default:
+    return m_xfmArray->size();
+  }
+}
+
+math::mat4 Instance::transform(size_t i) const
+{
+  switch (m_xfmFormat) {
+  case XFM_MAT4:
+    return m_xfmArray->beginAs<math::mat4>()[i];
+  case XFM_MAT3x4: {
+    const auto *c = (const math::float3 *)m_xfmArray->data() + 4 * i;
+    return math::mat4{{c[0].x, c[0].y, c[0].z, 0.f},
+        {c[1].x, c[1].y, c[1].z, 0.f},
+        {c[2].x, c[2].y, c[2].z, 0.f},
+        {c[3].x, c[3].y, c[3].z, 1.f}};
+  }
+  case XFM_TRANSLATION:
+    return math::translation_matrix(
+        ((const math::float3 *)m_xfmArray->data())[i]);
+  case XFM_TRANSLATION_SCALE: {
+    const auto ts = ((const math::float4 *)m_xfmArray->data())[i];
+    return math::mat4{{ts.w, 0.f, 0.f, 0.f},
+        {0.f, ts.w, 0.f, 0.f},
+        {0.f, 0.f, ts.w, 0.f},
+        {ts.x, ts.y, ts.z, 1.f}};
+  }
+  case XFM_TRS: {
+    // Arrays which are missing or shorter than the others contribute identity
+    math::float4 r(0.f, 0.f, 0.f, 1.f);
+    math::float3 t(0.f);
+    math::float3 s(1.f);
+    if (m_xfmRotation && i < m_xfmRotation->size())
+      r = ((const math::float4 *)m_xfmRotation->data())[i];
+    if (m_xfmTranslation && i < m_xfmTranslation->size())
+      t = ((const math::float3 *)m_xfmTranslation->data())[i];
+    if (m_xfmScale && i < m_xfmScale->size()) {
+      if (m_xfmScale->elementType() == ANARI_FLOAT32)
+        s = math::float3(((const float *)m_xfmScale->data())[i]);
+      else
+        s = ((const math::float3 *)m_xfmScale->data())[i];
+    }
+    return math::mul(math::translation_matrix(t),
+        math::mul(math::rotation_matrix(r), math::scaling_matrix(s)));
+  }
+  case XFM_SINGLE:
+  default:
+    return m_xfm;
+  }
+}
+
+bool Instance::canUpdateTransformsInPlace() const
+{
+  return isValid() && m_syncedGroup == m_group.ptr
+      && m_group->lastChange() < m_lastSync
+      && numTransforms() * m_cyclesItems.size() == m_cyclesObjects.size();
+}
+
+void Instance::updateCyclesTransforms()
+{
+  writeCyclesTransforms(false);
+  writeCyclesAttributes();
+  const size_t numUpdated = tagModifiedObjects();
+  reportMessage(ANARI_SEVERITY_DEBUG,
+      "anari_cycles::Instance updated %zu objects in place",
+      numUpdated);
+}
+
+void Instance::updateCyclesLightTransforms()
+{
+  // A changed group resyncs the world, which rewrites every transform anyway
+  if (!canUpdateTransformsInPlace())
+    return;
+
+  writeCyclesTransforms(true);
+  const size_t numUpdated = tagModifiedObjects();
+  if (numUpdated > 0) {
+    reportMessage(ANARI_SEVERITY_DEBUG,
+        "anari_cycles::Instance updated %zu light transforms in place",
+        numUpdated);
+  }
+}
+
+void Instance::writeCyclesTransforms(bool lightsOnly)
+{
+  const size_t numItems = m_cyclesItems.size();
+  if (numItems == 0)
+    return;
+  const size_t numXfms = m_cyclesObjects.size() / numItems;
+
+  // Light orientations are the same for every instance transform
+  std::vector<math::mat4> lightXfms(numItems);
+  for (size_t j = 0; j < numItems; j++) {
+    if (const auto &l = m_cyclesItems[j].light; l)
+      lightXfms[j] = l->xfm();
+  }
+
+  parallelForChunks(numXfms, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const auto xfm = transform(i);
+      const auto cyclesXfm = mat4ToCycles(xfm);
+      auto **row = m_cyclesObjects.data() + i * numItems;
+      for (size_t j = 0; j < numItems; j++) {
+        if (m_cyclesItems[j].light)
+          row[j]->set_tfm(mat4ToCycles(math::mul(xfm, lightXfms[j])));
+        else if (!lightsOnly)
+          row[j]->set_tfm(cyclesXfm);
+      }
+    }
+  });
+}
+
+void Instance::writeCyclesAttributes()
+{
+  const bool hasInstanceAttributes = std::any_of(std::begin(m_attributes),
+      std::end(m_attributes),
+      [](const InstanceAttribute &a) { return *a.array || a.value; });
+  // Objects of surfaces sharing geometry nodes with other materials also get
+  // the material slot the nodes' shader selects with
+  const bool hasMaterialSlots = std::any_of(m_cyclesItems.begin(),
+      m_cyclesItems.end(),
+      [](const Group::CyclesItem &item) { return item.materialSlot != 0; });
+  const bool hasAttributes = hasInstanceAttributes || hasMaterialSlots;
+
+  // Nothing to add, and nothing left over from a previous sync to clear
+  if (!hasAttributes && !m_hasCyclesAttributes)
+    return;
+  m_hasCyclesAttributes = hasAttributes;
+
+  const size_t numItems = m_cyclesItems.size();
+  if (numItems == 0)
+    return;
+  const size_t numXfms = m_cyclesObjects.size() / numItems;
+
+  // Convert each array once for every transform, and name the attributes
+  // once, so the loop below only reads plain values
+  struct Source
+  {
+    ccl::ustring name;
+    bool perTransform;
+    std::vector<float4> values;
+    float4 value;
+  };
+  std::vector<Source> sources;
+  for (const auto &a : m_attributes) {
+    if (const Array1D *array = a.array->get(); array) {
+      Source src{ccl::ustring(a.name), true};
+      src.values.resize(std::min(numXfms, array->size()));
+      convertArray(array, src.values.data(), src.values.size());
+      sources.push_back(std::move(src));
+    } else if (a.value) {
+      sources.push_back({ccl::ustring(a.name), false, {}, *a.value});
+    }
+  }
+
+  const ccl::ustring slotName(CYCLES_MATERIAL_SLOT_ATTRIBUTE);
+
+  // Whether the object's attributes already name the values 'i' has, in
+  // the same order, letting single entries be replaced
+  auto sameLayout = [&](const ccl::vector<ccl::ParamValue> &attributes,
+                        size_t i,
+                        bool hasSlot) {
+    size_t n = 0;
+    for (const auto &src : sources) {
+      if (src.perTransform && i >= src.values.size())
+        continue;
+      if (n >= attributes.size() || attributes[n].name() != src.name
+          || attributes[n].type() != ccl::TypeFloat4)
+        return false;
+      n++;
+    }
+    if (hasSlot) {
+      if (n >= attributes.size() || attributes[n].name() != slotName
+          || attributes[n].type() != ccl::TypeFloat)
+        return false;
+      n++;
+    }
+    return n == attributes.size();
+  };
+
+  m_attributesChanged.assign(m_cyclesObjects.size(), 0);
+
+  parallelForChunks(numXfms, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      auto value = [&](const Source &src) -> const float4 * {
+        if (!src.perTransform)
+          return &src.value;
+        return i < src.values.size() ? &src.values[i] : nullptr;
+      };
+
+      auto **row = m_cyclesObjects.data() + i * numItems;
+      for (size_t j = 0; j < numItems; j++) {
+        if (m_cyclesItems[j].light)
+          continue;
+        auto &attributes = row[j]->attributes;
+        const float slot = float(m_cyclesItems[j].materialSlot);
+        bool changed = false;
+
+        if (sameLayout(attributes, i, slot != 0.f)) {
+          // Only values which differ are replaced, so unchanged objects
+          // don't allocate
+          size_t n = 0;
+          for (const auto &src : sources) {
+            const float4 *v = value(src);
+            if (!v)
+              continue;
+            auto &p = attributes[n++];
+            if (std::memcmp(p.data(), v, sizeof(float4)) != 0) {
+              p = ccl::ParamValue(src.name, ccl::TypeFloat4, 1, v);
+              changed = true;
+            }
+          }
+          if (slot != 0.f) {
+            auto &p = attributes[n];
+            if (std::memcmp(p.data(), &slot, sizeof(float)) != 0) {
+              p = ccl::ParamValue(slotName, ccl::TypeFloat, 1, &slot);
+              changed = true;
+            }
+          }
+        } else {
+          attributes.clear();
+          for (const auto &src : sources) {
+            if (const float4 *v = value(src); v)
+              attributes.emplace_back(src.name, ccl::TypeFloat4, 1, v);
+          }
+          if (slot != 0.f)
+            attributes.emplace_back(slotName, ccl::TypeFloat, 1, &slot);
+          changed = true;
+        }
+
+        m_attributesChanged[i * numItems + j] = changed;
+      }
+    }
+  });
+}
+
+size_t Instance::tagModifiedObjects()
+{
+  // Tagging updates the scene managers' flags, so it stays serial. Object
+  // attributes aren't a node socket, so objects which only had them rewritten
+  // are tagged with no socket modified, keeping their transform untouched.
+  auto *scene = deviceState()->scene;
+  size_t numModified = 0;
+  for (size_t k = 0; k < m_cyclesObjects.size(); k++) {
+    auto *o = m_cyclesObjects[k];
+    const bool attributesChanged =
+        k < m_attributesChanged.size() && m_attributesChanged[k];
+    if (o->is_modified() || attributesChanged) {
+      o->tag_update(scene);
+      numModified++;
+    }
+  }
+  m_attributesChanged.clear();
+  return numModified;
+}
+
 } // namespace anari_cycles
 
 CYCLES_ANARI_TYPEFOR_DEFINITION(anari_cycles::Instance *);
@@ -4,6 +4,11 @@
 #pragma once
 
 #include "Group.h"
+// cycles
+#include "scene/object.h"
+// std
+#include <optional>
+#include <vector>
 
 namespace anari_cycles {
 
@@ -13,19 +18,80 @@ struct Instance : public Object
   ~Instance() override;
 
   void commitParameters() override;
+  void finalize() override;
+  void markFinalized() override;
 
   Group *group() const;
 
-  void addInstanceObjectsToCyclesScene();
+  // Create, update, or delete only the ccl::Objects which differ from what
+  // was placed in the Cycles scene by the previous sync
+  void syncCyclesObjects();
+  void releaseCyclesObjects();
+  // Reapply the transforms of existing light objects after a light changed
+  // its orientation, leaving every other object untouched
+  void updateCyclesLightTransforms();
 
   box3 bounds() const override;
 
   bool isValid() const override;
 
  private:
+  // Supported encodings of the instance transform(s)
+  enum TransformFormat
+  {
+    XFM_SINGLE, // 'transform' as a single mat4 parameter
+    XFM_MAT4, // 'transform' array of mat4
+    XFM_MAT3x4, // 'transform' array of 3x4 affine matrices
+    XFM_TRANSLATION, // 'transform' array of vec3 translations
+    XFM_TRANSLATION_SCALE, // 'transform' array of vec4 translation + scale
+    XFM_TRS // 'transform.rotation/translation/scale' arrays
+  };
+
+  void updateTransformFormat();
+  size_t numTransforms() const;
+  math::mat4 transform(size_t i) const;
+
+  bool canUpdateTransformsInPlace() const;
+  void updateCyclesTransforms();
+  void writeCyclesTransforms(bool lightsOnly);
+  void writeCyclesAttributes();
+  size_t tagModifiedObjects();
+
   helium::IntrusivePtr<Group> m_group;
   helium::ChangeObserverPtr<Array1D> m_xfmArray;
+  helium::ChangeObserverPtr<Array1D> m_xfmRotation;
+  helium::ChangeObserverPtr<Array1D> m_xfmTranslation;
+  helium::ChangeObserverPtr<Array1D> m_xfmScale;
   math::mat4 m_xfm;
+  TransformFormat m_xfmFormat{XFM_SINGLE};
+
+  // Per-instance attributes, exposed to materials as Cycles object attributes
+  // under the same names geometry attributes use ("color", "attributeN")
+  struct InstanceAttribute
+  {
+    const char *name{nullptr};
+    helium::ChangeObserverPtr<Array1D> *array{nullptr}; // one per transform
+    std::optional<float4> value; // shared by all transforms
+  };
+
+  helium::ChangeObserverPtr<Array1D> m_color;
+  helium::ChangeObserverPtr<Array1D> m_attribute0;
+  helium::ChangeObserverPtr<Array1D> m_attribute1;
+  helium::ChangeObserverPtr<Array1D> m_attribute2;
+  helium::ChangeObserverPtr<Array1D> m_attribute3;
+  InstanceAttribute m_attributes[5];
+  bool m_hasCyclesAttributes{false};
+  // Objects whose attributes were rewritten by the last writeCyclesAttributes()
+  std::vector<uint8_t> m_attributesChanged;
+
+  // Persistent mapping of (transform index, group item) --> ccl::Object, laid
+  // out as m_cyclesObjects[transformIndex * m_cyclesItems.size() + itemIndex]
+  std::vector<Group::CyclesItem> m_cyclesItems;
+  std::vector<ccl::Object *> m_cyclesObjects;
+  const Group *m_syncedGroup{nullptr};
+  // The items are only current while the synced group
+  // hasn't changed since this stamp
+  helium::TimeStamp m_lastSync{0};
 };
 
 } // namespace anari_cycles
@@ -91,14 +91,30 @@ struct HDRI : public Light
   void commitParameters() override;
   void finalize() override;
   math::mat4 xfm() const override;
+  bool visibleToCamera() const override;
 
  private:
+  void makeShader();
+  void releaseShader();
+  void updateShaderGraph();
+
   helium::IntrusivePtr<Array2D> m_radiance{};
+  // Radiance the current shader and its image handle were made from
+  const Array2D *m_shaderRadiance{nullptr};
+  ccl::ImageHandle m_image;
+  // Orientation and scale the current shader graph was built with
+  bool m_graphOutdated{true};
+  float m_graphAngle{0.f};
+  float3 m_graphAxis{};
+  float m_graphScale{0.f};
+
   math::float3 m_up{0.f, 1.f, 0.f};
   math::float3 m_direction{0.f, 0.f, -1.f};
 
   float m_scale{1.f};
   bool m_visible{true};
+  bool m_backgroundVisible{true}; // value the world last applied
+  int m_mapResolution{0};
 };
 
 // Light definitions //////////////////////////////////////////////////////////
@@ -110,7 +126,7 @@ Light::Light(CyclesGlobalState *s) : Object(ANARI_LIGHT, s)
 
 Light::~Light()
 {
-  deviceState()->scene->delete_node(m_cyclesLight);
+  deviceState()->deleteNodeDeferred(m_cyclesLight);
 }
 
 Light *Light::createInstance(std::string_view type, CyclesGlobalState *s)
@@ -143,6 +159,11 @@ ccl::Shader *Light::cyclesShader() const
   return m_cyclesShader;
 }
 
+bool Light::visibleToCamera() const
+{
+  return true;
+}
+
 // Directional definitions ////////////////////////////////////////////////////
 
 Directional::Directional(CyclesGlobalState *s) : Light(s) {}
@@ -162,9 +183,8 @@ void Directional::finalize()
   m_cyclesLight->set_light_type(LIGHT_DISTANT);
 
   if (m_prevDirection != m_direction) {
-    reportMessage(ANARI_SEVERITY_PERFORMANCE_WARNING,
-        "make light updates more efficient!");
-    deviceState()->objectUpdates.lastSceneChange = helium::newTimeStamp();
+    deviceState()->objectUpdates.lastLightTransformChange =
+        helium::newTimeStamp();
     m_prevDirection = m_direction;
   }
 
@@ -184,7 +204,10 @@ math::mat4 Directional::xfm() const
 
 HDRI::HDRI(CyclesGlobalState *s) : Light(s) {}
 
-HDRI::~HDRI() = default;
+HDRI::~HDRI()
+{
+  releaseShader();
+}
 
 void HDRI::commitParameters()
 {
@@ -193,6 +216,7 @@ void HDRI::commitParameters()
   m_radiance = getParamObject<Array2D>("radiance");
   m_scale = getParam<float>("scale", 1.f);
   m_visible = getParam<bool>("visible", true);
+  m_mapResolution = std::max(getParam<int>("mapResolution", 0), 0);
 
   m_up = getParam<math::float3>("up", {0.f, 1.f, 0.f});
   m_direction = getParam<math::float3>("direction", {0.f, 0.f, 1.f});
@@ -210,94 +234,142 @@ void HDRI::finalize()
 {
   Light::finalize();
 
+  auto *scene = deviceState()->scene;
+
   // Set light type for identification purposes
   m_cyclesLight->set_light_type(ccl::LIGHT_BACKGROUND);
-  m_cyclesLight->tag_update(deviceState()->scene);
 
-  if (m_cyclesShader) {
-    m_cyclesShader->dereference();
-    deviceState()->scene->delete_node(m_cyclesShader);
-    assert(m_cyclesShader->reference_count() == 0);
-    m_cyclesShader = nullptr;
+  // Importance sample the environment. Cycles evaluates the background shader
+  // once per map texel to build the sampling tables, so by default the map
+  // follows the image width but is capped to keep 8K+ images cheap to update.
+  int mapResolution = m_mapResolution;
+  if (mapResolution == 0 && m_radiance)
+    mapResolution = std::clamp(int(m_radiance->size(0)), 256, 2048);
+  m_cyclesLight->set_use_mis(true);
+  m_cyclesLight->set_map_resolution(mapResolution);
+
+  if (m_cyclesLight->is_modified())
+    m_cyclesLight->tag_update(scene);
+
+  // Only a different radiance array needs a new image and shader, the world
+  // then has to point the background at the new shader
+  if (m_radiance.ptr != m_shaderRadiance) {
+    releaseShader();
+    if (m_radiance)
+      makeShader();
+    m_shaderRadiance = m_radiance.ptr;
+    deviceState()->objectUpdates.lastSceneChange = helium::newTimeStamp();
   }
 
-  // Create shader for HDRI if radiance is provided
-  if (m_radiance) {
-    auto graph = std::make_unique<ccl::ShaderGraph>();
-
-    // Build orthonormal basis from direction and up vectors
-    // We should ensure that up is not parallel to forward, let save that for later.
-    auto forward = math::normalize(m_direction);
-    auto up = math::normalize(m_up);
-    auto right = math::normalize(math::cross(forward, up));
-    up = math::normalize(math::cross(right, forward)); // Ensure orthogonality
-
-    // Create rotation matrix (column-major: each column is a basis vector)
-    // Transform from standard basis to our custom orientation
-    // math::mat3 rotationMat = {
-    //     {forward.x, right.x, up.x},  // First column
-    //     {forward.y, right.y, up.y},  // Second column  
-    //     {forward.z, right.z, up.z}   // Third column
-    // };
-    math::mat3 rotationMat = {
-      forward, right, up
-    };
-
-    // Extract axis-angle representation for Cycles vector rotation node
-    // math::float3 axis;
-    // float angle;
-    // axis_angle_from_matrix(rotationMat, axis, angle);
-
-    auto rotation = math::rotation_quat(rotationMat);
-    float angle = qangle(rotation);
-    math::float3 axis = qaxis(rotation);
-
-    auto tex_coords = graph->create_node<ccl::TextureCoordinateNode>();
-
-    auto vectorRotate = graph->create_node<ccl::VectorRotateNode>();
-    vectorRotate->set_rotate_type(ccl::NODE_VECTOR_ROTATE_TYPE_AXIS);
-    vectorRotate->set_angle(angle);
-    vectorRotate->set_axis(ccl::make_float3(axis.x, axis.y, axis.z));
-    graph->connect(tex_coords->output("Generated"), vectorRotate->input("Vector"));
-    
-    // Create environment texture node
-    auto *env_tex = graph->create_node<ccl::EnvironmentTextureNode>();
-    env_tex->set_projection(ccl::NODE_ENVIRONMENT_EQUIRECTANGULAR);
-    env_tex->set_colorspace(ccl::u_colorspace_raw);
-    env_tex->set_tex_mapping_type(ccl::TextureMapping::VECTOR);
-    env_tex->set_tex_mapping_x_mapping(ccl::TextureMapping::X);
-    env_tex->set_tex_mapping_y_mapping(ccl::TextureMapping::Y);
-    env_tex->set_tex_mapping_z_mapping(ccl::TextureMapping::Z);
-    env_tex->set_tex_mapping_scale(ccl::make_float3(1.0f, 1.0f, 1.0f));
-
-    graph->connect(vectorRotate->output("Vector"), env_tex->input("Vector"));
-
-    // Use SamplerImageLoader to get the image handle
-    auto loader = std::make_unique<SamplerImageLoader>(m_radiance.ptr);
-    ccl::ImageParams params;
-    params.alpha_type = IMAGE_ALPHA_AUTO;
-    params.interpolation = INTERPOLATION_LINEAR;
-
-    env_tex->handle =
-      deviceState()->scene->image_manager->add_image(std::move(loader), params, false);
-
-    // Create output node
-    auto *background = graph->create_node<ccl::BackgroundNode>();
-    
-    // Connect environment texture to background
-    graph->connect(env_tex->output("Color"), background->input("Color"));
-
-    graph->connect(background->output("Background"), graph->output()->input("Surface"));
-
-    // Create shader and assign graph
-    m_cyclesShader = deviceState()->scene->create_node<ccl::Shader>();
-    graph->dump_graph("/tmp/blender.graph.world.dot");
-    m_cyclesShader->set_graph(std::move(graph));
-    m_cyclesShader->tag_update(deviceState()->scene);
-    m_cyclesShader->reference();
+  // Camera visibility is a setting of the scene background, which the world
+  // applies when it syncs
+  if (m_visible != m_backgroundVisible) {
+    m_backgroundVisible = m_visible;
+    deviceState()->objectUpdates.lastSceneChange = helium::newTimeStamp();
   }
 
-  deviceState()->objectUpdates.lastSceneChange = helium::newTimeStamp();
+  if (m_cyclesShader)
+    updateShaderGraph();
+}
+
+void HDRI::makeShader()
+{
+  auto *scene = deviceState()->scene;
+
+  // Use SamplerImageLoader to get the image handle
+  auto loader = std::make_unique<SamplerImageLoader>(m_radiance.ptr);
+  ccl::ImageParams params;
+  params.alpha_type = IMAGE_ALPHA_AUTO;
+  params.interpolation = INTERPOLATION_LINEAR;
+
+  m_image = scene->image_manager->add_image(std::move(loader), params, false);
+
+  // The graph is added by updateShaderGraph()
+  m_cyclesShader = scene->create_node<ccl::Shader>();
+  m_cyclesShader->reference();
+  m_graphOutdated = true;
+}
+
+void HDRI::releaseShader()
+{
+  if (!m_cyclesShader)
+    return;
+
+  m_cyclesShader->dereference();
+  deviceState()->deleteNodeDeferred(m_cyclesShader);
+  m_cyclesShader = nullptr;
+  m_image.clear();
+  m_shaderRadiance = nullptr;
+}
+
+void HDRI::updateShaderGraph()
+{
+  // Build orthonormal basis from direction and up vectors
+  // We should ensure that up is not parallel to forward, let save that for later.
+  auto forward = math::normalize(m_direction);
+  auto up = math::normalize(m_up);
+  auto right = math::normalize(math::cross(forward, up));
+  up = math::normalize(math::cross(right, forward)); // Ensure orthogonality
+
+  // Extract axis-angle representation for Cycles vector rotation node
+  math::mat3 rotationMat = {forward, right, up};
+  auto rotation = math::rotation_quat(rotationMat);
+  const float angle = qangle(rotation);
+  const math::float3 a = qaxis(rotation);
+  const float3 axis = ccl::make_float3(a.x, a.y, a.z);
+
+  if (!m_graphOutdated && m_graphAngle == angle && m_graphAxis == axis
+      && m_graphScale == m_scale)
+    return;
+
+  // Compiling a graph constant folds it in place, e.g. the background node
+  // is removed at zero strength, so changes build a new graph rather than
+  // editing nodes of the old one. The image handle is shared by both.
+  //
+  // Known limit: any change to the background shader, 'scale' included, makes
+  // Cycles rebuild the importance sampling tables from the image. Cycles has
+  // no strength outside the shader which camera and BSDF rays both honor, so
+  // a scale change can't reuse the tables even though their shape is equal.
+  auto graph = std::make_unique<ccl::ShaderGraph>();
+
+  auto tex_coords = graph->create_node<ccl::TextureCoordinateNode>();
+
+  auto *vectorRotate = graph->create_node<ccl::VectorRotateNode>();
+  vectorRotate->set_rotate_type(ccl::NODE_VECTOR_ROTATE_TYPE_AXIS);
+  vectorRotate->set_angle(angle);
+  vectorRotate->set_axis(axis);
+  graph->connect(
+      tex_coords->output("Generated"), vectorRotate->input("Vector"));
+
+  // Create environment texture node
+  auto *env_tex = graph->create_node<ccl::EnvironmentTextureNode>();
+  env_tex->set_projection(ccl::NODE_ENVIRONMENT_EQUIRECTANGULAR);
+  env_tex->set_colorspace(ccl::u_colorspace_raw);
+  env_tex->set_tex_mapping_type(ccl::TextureMapping::VECTOR);
+  env_tex->set_tex_mapping_x_mapping(ccl::TextureMapping::X);
+  env_tex->set_tex_mapping_y_mapping(ccl::TextureMapping::Y);
+  env_tex->set_tex_mapping_z_mapping(ccl::TextureMapping::Z);
+  env_tex->set_tex_mapping_scale(ccl::make_float3(1.0f, 1.0f, 1.0f));
+
+  graph->connect(vectorRotate->output("Vector"), env_tex->input("Vector"));
+  env_tex->handle = m_image;
+
+  // Create output node
+  auto *background = graph->create_node<ccl::BackgroundNode>();
+  background->set_strength(m_scale);
+
+  // Connect environment texture to background
+  graph->connect(env_tex->output("Color"), background->input("Color"));
+  graph->connect(
+      background->output("Background"), graph->output()->input("Surface"));
+
+  m_cyclesShader->set_graph(std::move(graph));
+  m_cyclesShader->tag_update(deviceState()->scene);
+
+  m_graphOutdated = false;
+  m_graphAngle = angle;
+  m_graphAxis = axis;
+  m_graphScale = m_scale;
 }
 
 math::mat4 HDRI::xfm() const
@@ -306,6 +378,11 @@ math::mat4 HDRI::xfm() const
 
 }
 
+bool HDRI::visibleToCamera() const
+{
+  return m_visible;
+}
+
 } // namespace anari_cycles
 
 CYCLES_ANARI_TYPEFOR_DEFINITION(anari_cycles::Light *);
@@ -26,6 +26,8 @@ struct Light : public Object
   ccl::Shader *cyclesShader() const;
 
   virtual math::mat4 xfm() const = 0;
+  // Whether camera rays see the light directly, only backgrounds can hide
+  virtual bool visibleToCamera() const;
 
  protected:
   ccl::Light *m_cyclesLight{nullptr};
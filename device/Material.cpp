@@ -2,7 +2,10 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "Material.h"
+#include "Geometry.h"
 #include "Sampler.h"
+// std
+#include <algorithm>
 
 namespace anari_cycles {
 
@@ -14,12 +17,9 @@ struct MatteMaterial : public Material
   ~MatteMaterial() override = default;
 
   void commitParameters() override;
-  void finalize() override;
 
  private:
-  void makeGraph() override;
-
-  ccl::PrincipledBsdfNode *m_bsdf{nullptr};
+  ccl::ShaderOutput *makeGraph() override;
 
   std::string m_colorAttr;
   float3 m_color{make_float3(0.8f, 0.8f, 0.8f)};
@@ -47,38 +47,29 @@ void MatteMaterial::commitParameters()
   m_mode = helium::alphaModeFromString(getParamString("alphaMode", "opaque"));
 }
 
-void MatteMaterial::finalize()
+ccl::ShaderOutput *MatteMaterial::makeGraph()
 {
-  auto &state = *deviceState();
-
-  makeGraph();
+  Material::makeGraph();
+  auto *bsdf = m_graph->create_node<ccl::PrincipledBsdfNode>();
+  bsdf->input("Roughness")->set(1.f);
+  bsdf->input("Metallic")->set(0.f);
+  bsdf->input("Coat Weight")->set(0.f);
+  bsdf->input("Transmission Weight")->set(0.f);
 
-  connectAttributes(m_bsdf,
+  connectAttributes(bsdf,
       m_colorAttr,
       "Base Color",
       m_color,
       m_colorSampler.get());
 
   const bool isOpaque = m_mode == helium::AlphaMode::OPAQUE;
-  connectAttributes(m_bsdf,
+  connectAttributes(bsdf,
       m_opacityAttr,
       "Alpha",
       isOpaque ? 1.f : m_opacity,
       m_opacitySampler && !isOpaque ? m_opacitySampler.get() : nullptr);
 
-  m_shader->tag_update(deviceState()->scene);
-  Material::finalize();
-}
-
-void MatteMaterial::makeGraph()
-{
-  Material::makeGraph();
-  m_bsdf = m_graph->create_node<ccl::PrincipledBsdfNode>();
-  m_graph->connect(m_bsdf->output("BSDF"), m_graph->output()->input("Surface"));
-  m_bsdf->input("Roughness")->set(1.f);
-  m_bsdf->input("Metallic")->set(0.f);
-  m_bsdf->input("Coat Weight")->set(0.f);
-  m_bsdf->input("Transmission Weight")->set(0.f);
+  return bsdf->output("BSDF");
 }
 
 // PhysicallyBasedMaterial ////////////////////////////////////////////////////
@@ -89,12 +80,10 @@ struct PhysicallyBasedMaterial : public Material
   ~PhysicallyBasedMaterial() override = default;
 
   void commitParameters() override;
-  void finalize() override;
 
  private:
-  void makeGraph() override;
+  ccl::ShaderOutput *makeGraph() override;
 
-  ccl::PrincipledBsdfNode *m_bsdf{nullptr};
   std::string m_colorAttr;
   float3 m_color{make_float3(0.8f, 0.8f, 0.8f)};
   helium::ChangeObserverPtr<Sampler> m_colorSampler;
@@ -171,75 +160,62 @@ void PhysicallyBasedMaterial::commitParameters()
   m_mode = helium::alphaModeFromString(getParamString("alphaMode", "opaque"));
 }
 
-void PhysicallyBasedMaterial::finalize()
+ccl::ShaderOutput *PhysicallyBasedMaterial::makeGraph()
 {
-  auto &state = *deviceState();
-
-  makeGraph();
+  Material::makeGraph();
+  auto *bsdf = m_graph->create_node<ccl::PrincipledBsdfNode>();
+  bsdf->input("Emission Strength")->set(1.f);
 
-  connectAttributes(m_bsdf,
+  connectAttributes(bsdf,
       m_colorAttr,
       "Base Color",
       m_color,
       m_colorSampler.get());
 
   const bool isOpaque = m_mode == helium::AlphaMode::OPAQUE;
-  connectAttributes(m_bsdf,
+  connectAttributes(bsdf,
       m_opacityAttr,
       "Alpha",
       isOpaque ? 1.f : m_opacity,
       m_opacitySampler && !isOpaque ? m_opacitySampler.get() : nullptr);
 
-  connectAttributes(m_bsdf,
+  connectAttributes(bsdf,
       m_roughnessAttr,
       "Roughness",
       m_roughness,
       m_roughnessSampler.get());
 
-  connectAttributes(m_bsdf,
+  connectAttributes(bsdf,
       m_metallicAttr,
       "Metallic",
       m_metallic,
       m_metallicSampler.get());
 
-  connectAttributes(m_bsdf, m_clearcoatAttr, "Coat Weight", m_clearcoat);
+  connectAttributes(bsdf, m_clearcoatAttr, "Coat Weight", m_clearcoat);
   connectAttributes(
-      m_bsdf, m_clearcoatRoughnessAttr, "Coat Roughness", m_clearcoatRoughness);
-  connectAttributes(m_bsdf, m_emissiveAttr, "Emission Color", m_emissive);
+      bsdf, m_clearcoatRoughnessAttr, "Coat Roughness", m_clearcoatRoughness);
+  connectAttributes(bsdf, m_emissiveAttr, "Emission Color", m_emissive);
   connectAttributes(
-      m_bsdf, m_transmissionAttr, "Transmission Weight", m_transmission);
-  m_bsdf->input("IOR")->set(m_ior);
+      bsdf, m_transmissionAttr, "Transmission Weight", m_transmission);
+  bsdf->input("IOR")->set(m_ior);
 
   if (m_normalSampler) {
     // Does not work yet, most probably need to figure out tangent space handling in Cycles
     //
     // m_graph->connect(getSamplerOutputs(m_normalSampler.get()).normalOutput,
-    //    m_bsdf->input("Normal"));
+    //    bsdf->input("Normal"));
   }
 
-  m_shader->tag_update(deviceState()->scene);
-
-  Material::finalize();
-}
-
-void PhysicallyBasedMaterial::makeGraph()
-{
-  Material::makeGraph();
-  m_bsdf = m_graph->create_node<ccl::PrincipledBsdfNode>();
-  m_graph->connect(m_bsdf->output("BSDF"), m_graph->output()->input("Surface"));
-  m_bsdf->input("Emission Strength")->set(1.f);
+  return bsdf->output("BSDF");
 }
 
 // Material definitions ///////////////////////////////////////////////////////
 
-Material::Material(CyclesGlobalState *s) : Object(ANARI_MATERIAL, s)
-{
-  m_shader = s->scene->create_node<ccl::Shader>();
-}
+Material::Material(CyclesGlobalState *s) : Object(ANARI_MATERIAL, s) {}
 
 Material::~Material()
 {
-  deviceState()->scene->delete_node(cyclesShader());
+  deviceState()->deleteNodeDeferred(m_shader);
 }
 
 Material *Material::createInstance(std::string_view type, CyclesGlobalState *s)
@@ -254,6 +230,8 @@ Material *Material::createInstance(std::string_view type, CyclesGlobalState *s)
 
 void Material::finalize()
 {
+  if (m_shader)
+    syncCyclesShader();
   Object::finalize();
 }
 
@@ -262,32 +240,81 @@ ccl::Shader *Material::cyclesShader()
   return m_shader;
 }
 
-void Material::makeGraph()
+void Material::retainCyclesShader()
+{
+  if (m_shaderUsers++ > 0)
+    return;
+  m_shader = deviceState()->scene->create_node<ccl::Shader>();
+  syncCyclesShader();
+}
+
+void Material::releaseCyclesShader()
 {
+  if (m_shaderUsers == 0 || --m_shaderUsers > 0)
+    return;
+  deviceState()->deleteNodeDeferred(m_shader);
+  m_shader = nullptr;
   m_samplerOutputs.clear();
+}
+
+ccl::ShaderOutput *Material::addCyclesClosure(ccl::ShaderGraph *graph)
+{
+  m_graph = graph;
+  auto *closure = makeGraph();
+  m_graph = nullptr;
+  return closure;
+}
+
+void Material::addCombinedShaderUser(Geometry *geometry)
+{
+  m_combinedShaderUsers.push_back(geometry);
+}
+
+void Material::removeCombinedShaderUser(Geometry *geometry)
+{
+  auto it = std::find(
+      m_combinedShaderUsers.begin(), m_combinedShaderUsers.end(), geometry);
+  if (it != m_combinedShaderUsers.end())
+    m_combinedShaderUsers.erase(it);
+}
 
+void Material::syncCyclesShader()
+{
   auto graph = std::make_unique<ccl::ShaderGraph>();
-  m_graph = graph.get();
+  if (auto *closure = addCyclesClosure(graph.get()); closure)
+    graph->connect(closure, graph->output()->input("Surface"));
+  m_shader->set_graph(std::move(graph));
+  m_shader->tag_update(deviceState()->scene);
+
+  // Iterate a copy, rebuilding may update a geometry's registration
+  const auto users = m_combinedShaderUsers;
+  for (auto *g : users)
+    g->updateCyclesShader();
+}
+
+ccl::ShaderOutput *Material::makeGraph()
+{
+  m_samplerOutputs.clear();
 
   auto *vertexColor = m_graph->create_node<ccl::AttributeNode>();
   vertexColor->name = "vertexColor";
-  vertexColor->set_attribute(ccl::ustring("vertex.color"));
+  vertexColor->set_attribute(ccl::ustring("color"));
 
   auto *attr0 = m_graph->create_node<ccl::AttributeNode>();
   attr0->name = "attr0";
-  attr0->set_attribute(ccl::ustring("vertex.attribute0"));
+  attr0->set_attribute(ccl::ustring("attribute0"));
 
   auto *attr1 = m_graph->create_node<ccl::AttributeNode>();
   attr1->name = "attr1";
-  attr1->set_attribute(ccl::ustring("vertex.attribute1"));
+  attr1->set_attribute(ccl::ustring("attribute1"));
 
   auto *attr2 = m_graph->create_node<ccl::AttributeNode>();
   attr2->name = "attr2";
-  attr2->set_attribute(ccl::ustring("vertex.attribute2"));
+  attr2->set_attribute(ccl::ustring("attribute2"));
 
   auto *attr3 = m_graph->create_node<ccl::AttributeNode>();
   attr3->name = "attr3";
-  attr3->set_attribute(ccl::ustring("vertex.attribute3"));
+  attr3->set_attribute(ccl::ustring("attribute3"));
 
   auto *vertexColor_sc = m_graph->create_node<ccl::SeparateColorNode>();
   m_graph->connect(vertexColor->output("Color"), vertexColor_sc->input("Color"));
@@ -315,7 +342,7 @@ void Material::makeGraph()
   m_attributeNodes.attr2_sc = attr2_sc->output("Red");
   m_attributeNodes.attr3_sc = attr3_sc->output("Red");
 
-  m_shader->set_graph(std::move(graph));
+  return nullptr;
 }
 
 void Material::connectAttributes(ccl::ShaderNode *bsdf,
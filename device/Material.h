@@ -6,6 +6,7 @@
 #include "Sampler.h"
 // std
 #include <map>
+#include <vector>
 // cycles
 #include "scene/shader.h"
 #include "scene/shader_graph.h"
@@ -13,6 +14,8 @@
 
 namespace anari_cycles {
 
+struct Geometry;
+
 struct Material : public Object
 {
   Material(CyclesGlobalState *s);
@@ -25,8 +28,25 @@ struct Material : public Object
 
   ccl::Shader *cyclesShader();
 
+  // The ccl::Shader only exists while resident surfaces use the material
+  void retainCyclesShader();
+  void releaseCyclesShader();
+
+  // Adds the material's nodes to 'graph' and returns its surface closure (if
+  // any), letting a geometry combine several materials in one shader
+  ccl::ShaderOutput *addCyclesClosure(ccl::ShaderGraph *graph);
+  // Geometries whose combined shader includes this material, they rebuild it
+  // whenever the material's own shader is rebuilt
+  void addCombinedShaderUser(Geometry *geometry);
+  void removeCombinedShaderUser(Geometry *geometry);
+
  protected:
-  virtual void makeGraph();
+  // Rebuild the shader graph from the current parameters, only called while
+  // the shader is resident
+  void syncCyclesShader();
+  // Adds the nodes to m_graph, overrides add their closure on top of the
+  // attribute nodes the base class provides
+  virtual ccl::ShaderOutput *makeGraph();
   void connectAttributes(ccl::ShaderNode *bsdf,
       const std::string &mode,
       const char *input,
@@ -46,7 +66,9 @@ struct Material : public Object
   std::map<Sampler*, SamplerOutputCache> m_samplerOutputs;
 
   ccl::Shader *m_shader{nullptr};
-  ccl::ShaderGraph *m_graph{nullptr};
+  ccl::ShaderGraph *m_graph{nullptr}; // only set while nodes are added
+  size_t m_shaderUsers{0};
+  std::vector<Geometry *> m_combinedShaderUsers;
   struct AttributeNodes
   {
     ccl::ShaderOutput *attrC{nullptr};
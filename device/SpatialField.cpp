@@ -2,10 +2,13 @@
 // SPDX-License-Identifier: Apache-2.0
 
 // std
+#include <algorithm>
 #include <limits>
+#include <numeric>
 // ours
 #include "SpatialField.h"
 #include "VolumeImageLoader.h"
+#include "array_conversion.h"
 // cycles
 #include "scene/volume.h"
 #include "util/hash.h"
@@ -13,6 +16,10 @@
 
 namespace anari_cycles {
 
+// Voxels per edge of the bricks the occupancy mesh is built from, small
+// enough to fit features, large enough to keep the mesh and its BVH tiny
+constexpr uint32_t OCCUPANCY_BRICK_SIZE = 8;
+
 SpatialField::SpatialField(CyclesGlobalState *s)
     : Object(ANARI_SPATIAL_FIELD, s)
 {}
@@ -30,9 +37,29 @@ SpatialField *SpatialField::createInstance(
 
 void SpatialField::finalize()
 {
+  // Volumes keep the old image alive through their own handles until they
+  // are written again
+  m_voxelImage.clear();
+  m_lastDataChange = helium::newTimeStamp();
+
   Object::finalize();
 }
 
+const ccl::ImageHandle &SpatialField::cyclesVoxelImage()
+{
+  if (m_voxelImage.empty()) {
+    ImageParams params;
+    m_voxelImage = deviceState()->scene->image_manager->add_image(
+        makeVoxelLoader(), params, false);
+  }
+  return m_voxelImage;
+}
+
+helium::TimeStamp SpatialField::lastDataChange() const
+{
+  return m_lastDataChange;
+}
+
 // Subtypes ///////////////////////////////////////////////////////////////////
 
 // StructuredRegularField //
@@ -59,6 +86,7 @@ void StructuredRegularField::finalize()
   m_coordUpperBound = helium::float3(std::nextafter(m_dims[0] - 1, 0),
       std::nextafter(m_dims[1] - 1, 0),
       std::nextafter(m_dims[2] - 1, 0));
+  m_brickRanges.clear();
 
   SpatialField::finalize();
 }
@@ -68,79 +96,236 @@ bool StructuredRegularField::isValid() const
   return m_data;
 }
 
-std::unique_ptr<ccl::Geometry> StructuredRegularField::makeCyclesGeometry()
+std::unique_ptr<ccl::ImageLoader> StructuredRegularField::makeVoxelLoader()
+    const
+{
+  return std::make_unique<VolumeImageLoader>(this);
+}
+
+void StructuredRegularField::computeBrickRanges()
+{
+  for (int a = 0; a < 3; a++) {
+    const uint32_t numCells = m_dims[a] > 1 ? m_dims[a] - 1 : 1;
+    m_numBricks[a] =
+        (numCells + OCCUPANCY_BRICK_SIZE - 1) / OCCUPANCY_BRICK_SIZE;
+  }
+
+  const size_t numBricks =
+      size_t(m_numBricks[0]) * m_numBricks[1] * m_numBricks[2];
+  m_brickRanges.resize(numBricks);
+
+  auto compute = [&](const auto *voxels) {
+    tbb::parallel_for(size_t(0), numBricks, [&](size_t b) {
+      const uint32_t brick[3] = {uint32_t(b % m_numBricks[0]),
+          uint32_t((b / m_numBricks[0]) % m_numBricks[1]),
+          uint32_t(b / (size_t(m_numBricks[0]) * m_numBricks[1]))};
+      uint32_t lo[3], hi[3];
+      for (int a = 0; a < 3; a++) {
+        lo[a] = brick[a] * OCCUPANCY_BRICK_SIZE;
+        hi[a] = std::min(lo[a] + OCCUPANCY_BRICK_SIZE, m_dims[a] - 1);
+      }
+
+      box1 range{std::numeric_limits<float>::max(),
+          -std::numeric_limits<float>::max()};
+      for (uint32_t z = lo[2]; z <= hi[2]; z++) {
+        for (uint32_t y = lo[1]; y <= hi[1]; y++) {
+          const size_t row = size_t(m_dims[0]) * (y + size_t(m_dims[1]) * z);
+          for (uint32_t x = lo[0]; x <= hi[0]; x++)
+            extend(range, voxelValue(voxels + row + x));
+        }
+      }
+      m_brickRanges[b] = range;
+    });
+  };
+
+  const void *data = m_data->data();
+  switch (m_data->elementType()) {
+  case ANARI_UFIXED8:
+    compute((const uint8_t *)data);
+    break;
+  case ANARI_UFIXED16:
+    compute((const uint16_t *)data);
+    break;
+  case ANARI_FIXED16:
+    compute((const int16_t *)data);
+    break;
+  case ANARI_FLOAT32:
+    compute((const float *)data);
+    break;
+  case ANARI_FLOAT64:
+    compute((const double *)data);
+    break;
+  default:
+    // Unknown data can't be classified, so every brick stays in the domain
+    std::fill(m_brickRanges.begin(),
+        m_brickRanges.end(),
+        box1{-std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::max()});
+    break;
+  }
+}
+
+void StructuredRegularField::writeCyclesVolume(
+    ccl::Volume *volume, const ValueVisibility &visible)
 {
-  auto volume = std::make_unique<ccl::Volume>();
+  // Rewritten from scratch, keeping the shader the volume node was given
+  volume->clear(true);
   volume->name = ccl::ustring("ANARI Volume");
 
   volume->set_clipping(-std::numeric_limits<float>::max());
   volume->set_object_space(true);
-#if 0
-  volume->set_volume_mesh(true);
-#endif
 
   Attribute *attr = volume->attributes.add(
       ustring("voxels"), ccl::TypeFloat, ATTR_ELEMENT_VOXEL);
-  auto loader = std::make_unique<VolumeImageLoader>(this);
-  ImageParams params;
-  auto &state = *deviceState();
-  attr->data_voxel() =
-      state.scene->image_manager->add_image(std::move(loader), params, false);
-
-  auto v_min = make_float3(0.5, 0.5f, 0.5f);
-  auto v_max =
-      make_float3(m_dims[0] - 0.5f, m_dims[1] - 0.5f, m_dims[2] - 0.5f);
-  auto vertices = std::vector<float3>{{v_min.x, v_min.y, v_max.z},
-      {v_max.x, v_min.y, v_max.z},
-      {v_min.x, v_max.y, v_max.z},
-      {v_max.x, v_max.y, v_max.z},
-      {v_min.x, v_min.y, v_min.z},
-      {v_max.x, v_min.y, v_min.z},
-      {v_min.x, v_max.y, v_min.z},
-      {v_max.x, v_max.y, v_min.z}};
+  attr->data_voxel() = cyclesVoxelImage();
+
+  if (m_brickRanges.empty())
+    computeBrickRanges();
+
+  // Cycles only steps through the inside of the proxy mesh, so enclosing
+  // just the bricks holding visible values skips the empty space around them
+  const size_t numBricks = m_brickRanges.size();
+  std::vector<uint8_t> occupied(numBricks);
+  parallelForChunks(numBricks, [&](size_t begin, size_t end) {
+    for (size_t b = begin; b < end; b++) {
+      const auto &r = m_brickRanges[b];
+      occupied[b] =
+          r.lower <= r.upper && (!visible || visible(r.lower, r.upper));
+    }
+  });
+
+  const uint32_t nb[3] = {m_numBricks[0], m_numBricks[1], m_numBricks[2]};
+  auto brickIndex = [&](const int32_t *c) {
+    return size_t(c[0]) + size_t(nb[0]) * (c[1] + size_t(nb[1]) * c[2]);
+  };
+  auto isOccupied = [&](const int32_t *c) {
+    for (int a = 0; a < 3; a++) {
+      if (c[a] < 0 || c[a] >= int32_t(nb[a]))
+        return false;
+    }
+    return occupied[brickIndex(c)] != 0;
+  };
+
+  // Brick corners sit on voxel centers, which Cycles places at i + 0.5
+  auto cornerCoord = [&](int a, uint32_t c) {
+    return std::min(c * OCCUPANCY_BRICK_SIZE, m_dims[a] - 1) + 0.5f;
+  };
+
+  // A brick corner is on the boundary exactly when the bricks around it
+  // disagree on occupancy, so vertices are numbered with a prefix sum over
+  // the corners instead of while walking the faces
+  const uint32_t nc[3] = {nb[0] + 1, nb[1] + 1, nb[2] + 1};
+  const size_t numCorners = size_t(nc[0]) * nc[1] * nc[2];
+  auto cornerIndex = [&](const int32_t *c) {
+    return size_t(c[0]) + size_t(nc[0]) * (c[1] + size_t(nc[1]) * c[2]);
+  };
+
+  std::vector<int> cornerVertex(numCorners + 1);
+  parallelForChunks(numCorners, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const int32_t c[3] = {int32_t(i % nc[0]),
+          int32_t((i / nc[0]) % nc[1]),
+          int32_t(i / (size_t(nc[0]) * nc[1]))};
+      int numOccupied = 0;
+      for (int k = 0; k < 8; k++) {
+        const int32_t brick[3] = {
+            c[0] - 1 + (k & 1), c[1] - 1 + ((k >> 1) & 1), c[2] - 1 + (k >> 2)};
+        numOccupied += isOccupied(brick);
+      }
+      cornerVertex[i] = numOccupied > 0 && numOccupied < 8;
+    }
+  });
+  std::exclusive_scan(
+      cornerVertex.begin(), cornerVertex.end(), cornerVertex.begin(), 0);
+
   ccl::array<ccl::float3> P;
-  P.resize(8);
-  std::copy(cbegin(vertices), cend(vertices), P.begin());
-  volume->set_verts(P);
+  ccl::float3 *dstP = P.resize(cornerVertex[numCorners]);
+  parallelForChunks(numCorners, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      if (cornerVertex[i + 1] == cornerVertex[i])
+        continue;
+      const uint32_t c[3] = {uint32_t(i % nc[0]),
+          uint32_t((i / nc[0]) % nc[1]),
+          uint32_t(i / (size_t(nc[0]) * nc[1]))};
+      dstP[cornerVertex[i]] = make_float3(
+          cornerCoord(0, c[0]), cornerCoord(1, c[1]), cornerCoord(2, c[2]));
+    }
+  });
 
-  auto faces = std::vector<int3>{{0, 1, 2},
-      {2, 1, 3},
-      {1, 5, 3},
-      {3, 5, 7},
-      {5, 4, 7},
-      {7, 4, 6},
-      {4, 0, 6},
-      {6, 0, 2},
-      {2, 3, 6},
-      {6, 3, 7},
-      {5, 4, 1},
-      {1, 4, 0}};
-  auto numTriangles = faces.size();
-  volume->reserve_mesh(numTriangles * 3, numTriangles);
-  for (const auto &f : faces) {
-    volume->add_triangle(f.x, f.y, f.z, 0, true);
-  }
+  // Faces between an occupied brick and an empty one (or the outside) make
+  // up the boundary, wound to face away from the occupied brick. Each z slab
+  // of bricks is walked twice in parallel, once to count its faces and once
+  // to write them after the slabs before it.
+  auto forEachFace = [&](int32_t z, auto &&f) {
+    for (int32_t y = 0; y < int32_t(nb[1]); y++) {
+      for (int32_t x = 0; x < int32_t(nb[0]); x++) {
+        const int32_t brick[3] = {x, y, z};
+        if (!isOccupied(brick))
+          continue;
+        for (int a = 0; a < 3; a++) {
+          const int u = (a + 1) % 3;
+          const int v = (a + 2) % 3;
+          for (int side = 0; side < 2; side++) {
+            int32_t neighbor[3] = {x, y, z};
+            neighbor[a] += side ? 1 : -1;
+            if (isOccupied(neighbor))
+              continue;
 
-  std::vector<float3> face_normals;
-  for (const auto &f : faces) {
-    auto v1 = vertices[f.x];
-    auto v2 = vertices[f.y];
-    auto v3 = vertices[f.z];
-    auto e1 = normalize(v2 - v1);
-    auto e2 = normalize(v3 - v1);
+            int32_t c[4][3];
+            for (int k = 0; k < 4; k++) {
+              std::copy_n(brick, 3, c[k]);
+              c[k][a] += side;
+            }
+            c[1][u] += 1;
+            c[2][u] += 1;
+            c[2][v] += 1;
+            c[3][v] += 1;
 
-    face_normals.push_back(cross(e1, e2));
-  }
+            int q[4];
+            for (int k = 0; k < 4; k++)
+              q[k] = cornerVertex[cornerIndex(c[k])];
+            if (!side)
+              std::swap(q[1], q[3]);
+            f(q);
+          }
+        }
+      }
+    }
+  };
 
-#if 0
-  Attribute *attr_fN = volume->attributes.add(ATTR_STD_FACE_NORMAL);
-  float3 *fN = attr_fN->data_float3();
-  for (size_t i = 0; i < face_normals.size(); ++i) {
-    fN[i] = face_normals[i];
-  }
-#endif
+  std::vector<size_t> slabFaces(nb[2] + 1, 0);
+  tbb::parallel_for(uint32_t(0), nb[2], [&](uint32_t z) {
+    forEachFace(int32_t(z), [&](const int *) { slabFaces[z]++; });
+  });
+  std::exclusive_scan(
+      slabFaces.begin(), slabFaces.end(), slabFaces.begin(), size_t(0));
+
+  const size_t numTriangles = 2 * slabFaces[nb[2]];
+  ccl::array<int> triangles;
+  ccl::array<int> shader;
+  ccl::array<bool> smooth;
+  int *dstIdx = triangles.resize(numTriangles * 3);
+  std::fill_n(shader.resize(numTriangles), numTriangles, 0);
+  std::fill_n(smooth.resize(numTriangles), numTriangles, true);
+
+  tbb::parallel_for(uint32_t(0), nb[2], [&](uint32_t z) {
+    int *dst = dstIdx + 6 * slabFaces[z];
+    forEachFace(int32_t(z), [&](const int *q) {
+      const int quad[6] = {q[0], q[1], q[2], q[0], q[2], q[3]};
+      dst = std::copy_n(quad, 6, dst);
+    });
+  });
+
+  volume->set_verts(P);
+  volume->set_triangles(triangles);
+  volume->set_shader(shader);
+  volume->set_smooth(smooth);
 
-  return volume;
+  reportMessage(ANARI_SEVERITY_DEBUG,
+      "anari_cycles::StructuredRegularField occupancy mesh encloses %zu of "
+      "%zu bricks",
+      size_t(std::count(occupied.begin(), occupied.end(), 1)),
+      numBricks);
 }
 
 box3 StructuredRegularField::bounds() const
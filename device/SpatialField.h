@@ -9,9 +9,18 @@
 #include "Material.h"
 // ours
 #include "scene/geometry.h"
+#include "scene/image.h"
+#include "scene/volume.h"
+// std
+#include <functional>
+#include <vector>
 
 namespace anari_cycles {
 
+// Whether a volume shows any value in [lower, upper], letting fields leave
+// regions which only hold invisible values out of the volume's domain
+using ValueVisibility = std::function<bool(float lower, float upper)>;
+
 struct SpatialField : public Object
 {
   SpatialField(CyclesGlobalState *s);
@@ -22,8 +31,25 @@ struct SpatialField : public Object
 
   void finalize() override;
 
-  virtual std::unique_ptr<ccl::Geometry> makeCyclesGeometry() = 0;
+  // The field's voxels are uploaded to Cycles as one image, created on first
+  // use and shared by every volume and instance referencing the field
+  const ccl::ImageHandle &cyclesVoxelImage();
+  // When the voxel image was last replaced, volumes written before that need
+  // to be written again
+  helium::TimeStamp lastDataChange() const;
+
+  // Writes the field's proxy mesh and voxel attribute to a volume node, the
+  // mesh only encloses regions where 'visible' accepts the field's values
+  virtual void writeCyclesVolume(
+      ccl::Volume *volume, const ValueVisibility &visible) = 0;
   virtual box3 bounds() const = 0;
+
+ protected:
+  virtual std::unique_ptr<ccl::ImageLoader> makeVoxelLoader() const = 0;
+
+ private:
+  ccl::ImageHandle m_voxelImage;
+  helium::TimeStamp m_lastDataChange{0};
 };
 
 // Subtypes ///////////////////////////////////////////////////////////////////
@@ -35,11 +61,25 @@ struct StructuredRegularField : public SpatialField
   void commitParameters() override;
   void finalize() override;
 
-  std::unique_ptr<ccl::Geometry> makeCyclesGeometry() override;
+  void writeCyclesVolume(
+      ccl::Volume *volume, const ValueVisibility &visible) override;
 
   box3 bounds() const override;
   bool isValid() const override;
 
+ protected:
+  std::unique_ptr<ccl::ImageLoader> makeVoxelLoader() const override;
+
+ private:
+  void computeBrickRanges();
+
+  // Value range of each coarse brick of cells, including the voxels on its
+  // border, computed once per data change and classified per volume
+  std::vector<box1> m_brickRanges;
+  uint32_t m_numBricks[3]{0, 0, 0};
+
+ public:
+
   anari_vec::uint3 m_dims{0u};
   anari_vec::float3 m_origin;
   anari_vec::float3 m_spacing;
@@ -11,60 +11,69 @@ Surface::Surface(CyclesGlobalState *s)
 
 Surface::~Surface()
 {
-  cleanupCyclesNode();
+  releaseCyclesNode();
 }
 
 void Surface::commitParameters()
 {
-  auto *prevGeometry = m_geometry.get();
-  auto *prevMaterial = m_material.ptr;
   m_geometry = getParamObject<Geometry>("geometry");
   m_material = getParamObject<Material>("material");
-  m_geometryHandleChanged = prevGeometry != m_geometry.get();
-  m_materialHandleChanged = prevMaterial != m_material.ptr;
 }
 
 void Surface::finalize()
 {
-  auto *state = deviceState();
+  const auto prevNodes = m_cyclesGeometryNodes;
 
-  if (m_geometryHandleChanged) {
-    cleanupCyclesNode();
-    if (m_geometry)
-      m_cyclesGeometryNode = m_geometry->createCyclesGeometryNode();
-  }
-
-  if (isValid()) {
-    m_geometry->syncCyclesNode(m_cyclesGeometryNode);
-    if (m_materialHandleChanged || m_geometryHandleChanged) {
-      ccl::array<ccl::Node *> used_shaders;
-      used_shaders.push_back_slow(m_material->cyclesShader());
-      m_cyclesGeometryNode->set_used_shaders(used_shaders);
-    }
-    m_cyclesGeometryNode->tag_update(state->scene, true);
-  }
-
-  m_geometryHandleChanged = false;
-  m_materialHandleChanged = false;
+  // Surfaces the rendered world can't reach pick up their changes when they
+  // become resident
+  if (isResident())
+    updateCyclesNode();
 
-  state->objectUpdates.lastSceneChange = helium::newTimeStamp();
+  const bool valid = isValid();
+  m_worldResyncNeeded = prevNodes != m_cyclesGeometryNodes
+      || valid != m_wasValid || m_mergedUseCount > 0;
+  m_wasValid = valid;
+  m_lastChange = helium::newTimeStamp();
 
   Object::finalize();
 }
 
+void Surface::markFinalized()
+{
+  // The world only needs resyncing when the Cycles node it references was
+  // replaced or the surface became (in)valid, everything else was applied to
+  // the existing node in finalize()
+  if (m_worldResyncNeeded)
+    Object::markFinalized();
+  else
+    helium::BaseObject::markFinalized();
+}
+
 const Geometry *Surface::geometry() const
 {
   return m_geometry.get();
 }
 
-const Material *Surface::material() const
+Material *Surface::material() const
 {
   return m_material.ptr;
 }
 
-ccl::Geometry *Surface::cyclesGeometry() const
+helium::TimeStamp Surface::lastChange() const
+{
+  return m_lastChange;
+}
+
+const std::vector<ccl::Geometry *> &Surface::cyclesGeometries() const
+{
+  return m_cyclesGeometryNodes;
+}
+
+uint32_t Surface::cyclesMaterialSlot() const
 {
-  return m_cyclesGeometryNode;
+  return m_residentGeometry
+      ? m_residentGeometry->cyclesMaterialSlot(m_residentMaterial.ptr)
+      : 0;
 }
 
 bool Surface::isValid() const
@@ -81,12 +90,70 @@ void Surface::warnIfUnknownObject() const
     m_material->warnIfUnknownObject();
 }
 
-void Surface::cleanupCyclesNode()
+void Surface::retainCyclesResidency()
+{
+  if (m_residencyCount++ == 0)
+    updateCyclesNode();
+}
+
+void Surface::releaseCyclesResidency()
+{
+  if (m_residencyCount == 0 || --m_residencyCount > 0)
+    return;
+  releaseCyclesNode();
+}
+
+bool Surface::isResident() const
+{
+  return m_residencyCount > 0;
+}
+
+void Surface::retainMergedUse()
+{
+  m_mergedUseCount++;
+}
+
+void Surface::releaseMergedUse()
+{
+  if (m_mergedUseCount > 0)
+    m_mergedUseCount--;
+}
+
+void Surface::updateCyclesNode()
+{
+  Geometry *geometry = isValid() ? m_geometry.get() : nullptr;
+  Material *material = isValid() ? m_material.ptr : nullptr;
+
+  if (geometry != m_residentGeometry.ptr
+      || material != m_residentMaterial.ptr) {
+    // The nodes reference the material's shader, so keep it resident with
+    // us. Acquiring before releasing keeps nodes still in use from being
+    // recreated when only the material changed.
+    if (geometry) {
+      material->retainCyclesShader();
+      geometry->acquireCyclesNodes(material);
+    }
+    releaseCyclesNode();
+    m_residentGeometry = geometry;
+    m_residentMaterial = geometry ? material : nullptr;
+  }
+
+  // Chunked geometries can change their node count with any update
+  if (m_residentGeometry) {
+    m_residentGeometry->updateCyclesNodes();
+    m_cyclesGeometryNodes = m_residentGeometry->cyclesNodes();
+  }
+}
+
+void Surface::releaseCyclesNode()
 {
-  auto &state = *deviceState();
-  if (auto *cg = cyclesGeometry(); cg != nullptr)
-    state.scene->delete_node(cg);
-  m_cyclesGeometryNode = nullptr;
+  if (m_residentGeometry)
+    m_residentGeometry->releaseCyclesNodes(m_residentMaterial.ptr);
+  if (m_residentMaterial)
+    m_residentMaterial->releaseCyclesShader();
+  m_residentGeometry = nullptr;
+  m_residentMaterial = nullptr;
+  m_cyclesGeometryNodes.clear();
 }
 
 } // namespace anari_cycles
@@ -7,6 +7,8 @@
 #include "Material.h"
 // cycles
 #include "scene/geometry.h"
+// std
+#include <vector>
 
 namespace anari_cycles {
 
@@ -17,24 +19,49 @@ struct Surface : public Object
 
   void commitParameters() override;
   void finalize() override;
+  void markFinalized() override;
 
   const Geometry *geometry() const;
-  const Material *material() const;
+  Material *material() const;
+  // When the surface or its geometry last changed
+  helium::TimeStamp lastChange() const;
 
-  ccl::Geometry *cyclesGeometry() const;
+  // One node per chunk of the geometry
+  const std::vector<ccl::Geometry *> &cyclesGeometries() const;
+  // Selects the material on geometry nodes shared with other materials
+  uint32_t cyclesMaterialSlot() const;
+
+  // The Cycles geometry node (and the material's shader) only exist while
+  // the surface is reachable from the world being rendered
+  void retainCyclesResidency();
+  void releaseCyclesResidency();
+  bool isResident() const;
+
+  // Surfaces baked into a merged group mesh have no node of their own, so
+  // every change to them resyncs the world to let the group rebuild its mesh
+  void retainMergedUse();
+  void releaseMergedUse();
 
   bool isValid() const override;
   void warnIfUnknownObject() const override;
 
  private:
-  void cleanupCyclesNode();
+  void updateCyclesNode();
+  void releaseCyclesNode();
 
   helium::ChangeObserverPtr<Geometry> m_geometry;
   helium::IntrusivePtr<Material> m_material;
+  // Geometry and material the current Cycles nodes were acquired for, the
+  // material also holds a shader residency reference for this surface
+  helium::IntrusivePtr<Geometry> m_residentGeometry;
+  helium::IntrusivePtr<Material> m_residentMaterial;
+  size_t m_residencyCount{0};
+  size_t m_mergedUseCount{0};
+  helium::TimeStamp m_lastChange{0};
 
-  ccl::Geometry *m_cyclesGeometryNode{nullptr};
-  bool m_geometryHandleChanged{false};
-  bool m_materialHandleChanged{false};
+  std::vector<ccl::Geometry *> m_cyclesGeometryNodes;
+  bool m_wasValid{false};
+  bool m_worldResyncNeeded{true};
 };
 
 } // namespace anari_cycles
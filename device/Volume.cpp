@@ -3,6 +3,8 @@
 
 #include "Volume.h"
 // std
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 // cycles
 #include "graph/node_xml.h"
@@ -14,7 +16,10 @@ namespace anari_cycles {
 
 Volume::Volume(CyclesGlobalState *s) : Object(ANARI_VOLUME, s) {}
 
-Volume::~Volume() = default;
+Volume::~Volume()
+{
+  releaseCyclesNode();
+}
 
 Volume *Volume::createInstance(std::string_view subtype, CyclesGlobalState *s)
 {
@@ -24,15 +29,106 @@ Volume *Volume::createInstance(std::string_view subtype, CyclesGlobalState *s)
     return (Volume *)new UnknownObject(ANARI_VOLUME, subtype, s);
 }
 
+void Volume::finalize()
+{
+  const auto *prevNode = m_cyclesVolume;
+
+  // Volumes the rendered world can't reach pick up their changes when they
+  // become resident
+  if (m_residencyCount > 0)
+    updateCyclesNode();
+
+  const bool valid = isValid();
+  m_worldResyncNeeded = prevNode != m_cyclesVolume || valid != m_wasValid;
+  m_wasValid = valid;
+
+  Object::finalize();
+}
+
+void Volume::markFinalized()
+{
+  // Transfer function edits only touch the shader and field edits rewrite
+  // the existing node, neither changes what the world references
+  if (m_worldResyncNeeded)
+    Object::markFinalized();
+  else
+    helium::BaseObject::markFinalized();
+}
+
+void Volume::retainCyclesResidency()
+{
+  if (m_residencyCount++ == 0)
+    updateCyclesNode();
+}
+
+void Volume::releaseCyclesResidency()
+{
+  if (m_residencyCount == 0 || --m_residencyCount > 0)
+    return;
+  releaseCyclesNode();
+}
+
+ccl::Geometry *Volume::cyclesGeometry() const
+{
+  return m_cyclesVolume;
+}
+
+void Volume::updateCyclesNode()
+{
+  if (!isValid()) {
+    releaseCyclesNode();
+    return;
+  }
+
+  auto *scene = deviceState()->scene;
+  if (!m_cyclesVolume) {
+    m_cyclesVolume = scene->create_node<ccl::Volume>();
+    ccl::array<ccl::Node *> usedShaders;
+    usedShaders.push_back_slow(cyclesShader());
+    m_cyclesVolume->set_used_shaders(usedShaders);
+  }
+
+  // The voxels live in the field's shared image, so this only rewrites the
+  // occupancy mesh and the handle, when the field, its data or what the
+  // volume makes visible changed
+  auto *f = field();
+  if (f != m_syncedField || f->lastDataChange() > m_lastSynced
+      || lastVisibilityChange() > m_lastSynced) {
+    f->writeCyclesVolume(m_cyclesVolume, [&](float lower, float upper) {
+      return isValueVisible(lower, upper);
+    });
+    m_cyclesVolume->tag_update(scene, true);
+    m_syncedField = f;
+    m_lastSynced = helium::newTimeStamp();
+  }
+}
+
+bool Volume::isValueVisible(float /*lower*/, float /*upper*/) const
+{
+  return true;
+}
+
+helium::TimeStamp Volume::lastVisibilityChange() const
+{
+  return 0;
+}
+
+void Volume::releaseCyclesNode()
+{
+  deviceState()->deleteNodeDeferred(m_cyclesVolume);
+  m_cyclesVolume = nullptr;
+  m_syncedField = nullptr;
+  m_lastSynced = 0;
+}
+
 // Subtypes ///////////////////////////////////////////////////////////////////
 
-TransferFunction1D::TransferFunction1D(CyclesGlobalState *s) : Volume(s)
+TransferFunction1D::TransferFunction1D(CyclesGlobalState *s)
+    : Volume(s), m_field(this)
 {
   auto &state = *deviceState();
 
-  auto shader = std::make_unique<ccl::Shader>();
-  m_shader = shader.get();
-  state.scene->shaders.push_back(std::move(shader));
+  m_shader = state.scene->create_node<ccl::Shader>();
 
   auto graph = std::make_unique<ccl::ShaderGraph>();
   m_graph = graph.get();
@@ -65,8 +161,8 @@ TransferFunction1D::TransferFunction1D(CyclesGlobalState *s) : Volume(s)
 
 TransferFunction1D::~TransferFunction1D()
 {
-  auto &state = *deviceState();
-  state.scene->shaders.erase(cyclesShader());
+  // Deferred so the volume node, released after this, goes first
+  deviceState()->deleteNodeDeferred(m_shader);
 }
 
 ccl::Shader *TransferFunction1D::cyclesShader()
@@ -74,6 +170,11 @@ ccl::Shader *TransferFunction1D::cyclesShader()
   return m_shader;
 }
 
+SpatialField *TransferFunction1D::field() const
+{
+  return m_field.get();
+}
+
 bool TransferFunction1D::isValid() const
 {
   return m_field && m_field->isValid() && m_colorData && m_opacityData;
@@ -83,6 +184,8 @@ void TransferFunction1D::commitParameters()
 {
   Volume::commitParameters();
 
+  const auto prevValueRange = m_valueRange;
+
   m_field = getParamObject<SpatialField>("value");
   if (!m_field) {
     reportMessage(ANARI_SEVERITY_WARNING,
@@ -90,8 +193,6 @@ void TransferFunction1D::commitParameters()
     return;
   }
 
-  m_bounds = m_field->bounds();
-
   m_valueRange = getParam<helium::box1>("valueRange", helium::box1{0.f, 1.f});
 
   m_colorData = getParamObject<helium::Array1D>("color");
@@ -137,21 +238,53 @@ void TransferFunction1D::commitParameters()
     }
   }
 
+  // Only changes to which values are transparent reshape the volume's
+  // occupancy mesh, color and opacity edits elsewhere are shader only
+  std::vector<uint32_t> visibleCounts(m_opacityData->size() + 1, 0);
+  for (size_t i = 0; i < m_opacityData->size(); ++i)
+    visibleCounts[i + 1] = visibleCounts[i] + (opacityData[i] > 0.f);
+  if (visibleCounts != m_visibleCounts
+      || prevValueRange.lower != m_valueRange.lower
+      || prevValueRange.upper != m_valueRange.upper) {
+    m_visibleCounts = std::move(visibleCounts);
+    m_lastVisibilityChange = helium::newTimeStamp();
+  }
+
   m_shader->tag_update(deviceState()->scene);
 }
 
-std::unique_ptr<ccl::Geometry> TransferFunction1D::makeCyclesGeometry()
+bool TransferFunction1D::isValueVisible(float lower, float upper) const
+{
+  const size_t n = m_visibleCounts.empty() ? 0 : m_visibleCounts.size() - 1;
+  if (n == 0)
+    return false;
+
+  // Position of a value in the opacity ramp, as the shader's clamped map
+  // range node computes it
+  auto position = [&](float v) {
+    const float span = m_valueRange.upper - m_valueRange.lower;
+    const float t = span != 0.f ? (v - m_valueRange.lower) / span
+                                : (v < m_valueRange.lower ? 0.f : 1.f);
+    return std::clamp(t, 0.f, 1.f) * float(n - 1);
+  };
+
+  // The ramp interpolates, so the entries on either side of the range count
+  const float p0 = position(lower);
+  const float p1 = position(upper);
+  const size_t i0 = size_t(std::floor(std::min(p0, p1)));
+  const size_t i1 = std::min(size_t(std::ceil(std::max(p0, p1))), n - 1);
+  return m_visibleCounts[i1 + 1] > m_visibleCounts[i0];
+}
+
+helium::TimeStamp TransferFunction1D::lastVisibilityChange() const
 {
-  auto g = m_field->makeCyclesGeometry();
-  ccl::array<ccl::Node *> used_shaders;
-  used_shaders.push_back_slow(cyclesShader());
-  g->set_used_shaders(used_shaders);
-  return g;
+  return m_lastVisibilityChange;
 }
 
 box3 TransferFunction1D::bounds() const
 {
-  return m_bounds;
+  // Read live, the field can be recommitted without this volume being
+  return m_field ? m_field->bounds() : empty_box3();
 }
 
 // void TransferFunction1D::cleanup() {}
@@ -16,8 +16,38 @@ struct Volume : public Object
 
   static Volume *createInstance(std::string_view subtype, CyclesGlobalState *s);
 
-  virtual std::unique_ptr<ccl::Geometry> makeCyclesGeometry() = 0;
+  void finalize() override;
+  void markFinalized() override;
+
+  // One Cycles volume node per volume, placed by every instance of every
+  // group referencing it. It only exists while the volume is reachable from
+  // the world being rendered.
+  void retainCyclesResidency();
+  void releaseCyclesResidency();
+  ccl::Geometry *cyclesGeometry() const;
+
   virtual box3 bounds() const = 0;
+
+ protected:
+  virtual SpatialField *field() const = 0;
+  virtual ccl::Shader *cyclesShader() = 0;
+  // Whether any value in [lower, upper] is visible, volumes which can't
+  // tell keep the whole field in their domain
+  virtual bool isValueVisible(float lower, float upper) const;
+  // When the answers of isValueVisible() last changed
+  virtual helium::TimeStamp lastVisibilityChange() const;
+
+ private:
+  void updateCyclesNode();
+  void releaseCyclesNode();
+
+  ccl::Volume *m_cyclesVolume{nullptr};
+  // Field the node's voxels and occupancy mesh were written from, and when
+  const SpatialField *m_syncedField{nullptr};
+  helium::TimeStamp m_lastSynced{0};
+  size_t m_residencyCount{0};
+  bool m_wasValid{false};
+  bool m_worldResyncNeeded{true};
 };
 
 // Subtypes ///////////////////////////////////////////////////////////////////
@@ -30,14 +60,16 @@ struct TransferFunction1D : public Volume
   void commitParameters() override;
   bool isValid() const override;
 
-  std::unique_ptr<ccl::Geometry> makeCyclesGeometry() override;
-
   box3 bounds() const override;
 
- private:
-  helium::IntrusivePtr<SpatialField> m_field;
+ protected:
+  SpatialField *field() const override;
+  ccl::Shader *cyclesShader() override;
+  bool isValueVisible(float lower, float upper) const override;
+  helium::TimeStamp lastVisibilityChange() const override;
 
-  box3 m_bounds;
+ private:
+  helium::ChangeObserverPtr<SpatialField> m_field;
 
   helium::box1 m_valueRange{0.f, 1.f};
   float m_densityScale{1.f};
@@ -47,6 +79,11 @@ struct TransferFunction1D : public Volume
 
   std::vector<anari_vec::float4> m_rgbaMap;
 
+  // Running count of non-zero opacity entries, so isValueVisible() answers
+  // for a whole value range without scanning the opacity array
+  std::vector<uint32_t> m_visibleCounts;
+  helium::TimeStamp m_lastVisibilityChange{0};
+
   ccl::Shader *m_shader{nullptr};
   ccl::ShaderGraph *m_graph{nullptr};
 
@@ -57,8 +94,6 @@ struct TransferFunction1D : public Volume
   ccl::MathNode *m_mathNode{nullptr};
 
   ccl::PrincipledVolumeNode *m_volumeNode{nullptr};
-
-  ccl::Shader *cyclesShader();
 };
 
 } // namespace anari_cycles
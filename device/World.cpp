@@ -4,13 +4,58 @@
 #include "World.h"
 // std
 #include <algorithm>
+#include <unordered_set>
 // cycles
+#include "kernel/types.h"
 #include "scene/devicescene.h"
 #include "scene/object.h"
 #include "scene/background.h"
 
 namespace anari_cycles {
 
+// Helper functions ///////////////////////////////////////////////////////////
+
+// Returns the new resident list for 'reachable', taking a residency reference
+// on every object 'resident' doesn't already hold one for
+template <typename T>
+static std::vector<helium::IntrusivePtr<T>> retainReachable(
+    const std::vector<T *> &reachable,
+    const std::vector<helium::IntrusivePtr<T>> &resident)
+{
+  std::unordered_set<const T *> wasResident;
+  for (auto &o : resident)
+    wasResident.insert(o.ptr);
+
+  std::vector<helium::IntrusivePtr<T>> retained;
+  std::unordered_set<const T *> seen;
+  for (auto *o : reachable) {
+    if (!seen.insert(o).second)
+      continue;
+    if (wasResident.count(o) == 0)
+      o->retainCyclesResidency();
+    retained.emplace_back(o);
+  }
+  return retained;
+}
+
+// Releases the references 'previous' holds which 'current' no longer does
+template <typename T>
+static void releaseUnreachable(
+    const std::vector<helium::IntrusivePtr<T>> &previous,
+    const std::vector<helium::IntrusivePtr<T>> &current)
+{
+  std::unordered_set<const T *> isResident;
+  for (auto &o : current)
+    isResident.insert(o.ptr);
+
+  for (auto &o : previous) {
+    if (isResident.count(o.ptr) == 0)
+      o->releaseCyclesResidency();
+  }
+}
+
+// World definitions //////////////////////////////////////////////////////////
+
 World::World(CyclesGlobalState *s)
     : Object(ANARI_WORLD, s),
       m_zeroSurfaceData(this),
@@ -31,7 +76,14 @@ World::World(CyclesGlobalState *s)
   m_zeroInstance->finalize();
 }
 
-World::~World() = default;
+World::~World()
+{
+  auto &state = *deviceState();
+  if (state.currentWorld == this) {
+    releaseCyclesWorldObjects();
+    state.currentWorld = nullptr;
+  }
+}
 
 bool World::getProperty(const std::string_view &name,
     ANARIDataType type,
@@ -91,27 +143,84 @@ void World::finalize()
 void World::setCyclesWorldObjects()
 {
   auto &state = *deviceState();
-  auto *scene = state.scene;
 
-  scene->objects.clear();
+  auto instances = reachableInstances();
 
-  m_zeroInstance->addInstanceObjectsToCyclesScene();
+  // Make reachable surfaces and volumes resident before the previous world
+  // lets go of its own, so ones shared between the two keep their Cycles nodes
+  std::vector<Surface *> reachable;
+  std::vector<Volume *> reachableVolumes;
+  std::vector<Group *> reachableGroups;
+  for (auto *i : instances) {
+    if (i->isValid()) {
+      i->group()->gatherSurfaces(reachable);
+      i->group()->gatherVolumes(reachableVolumes);
+      reachableGroups.push_back(i->group());
+    }
+  }
 
-  if (m_instanceData) {
-    auto **instancesBegin = (Instance **)m_instanceData->handlesBegin();
-    auto **instancesEnd = (Instance **)m_instanceData->handlesEnd();
-    std::for_each(instancesBegin, instancesEnd, [](Instance *i) {
-      i->addInstanceObjectsToCyclesScene();
-    });
+  auto residentSurfaces = retainReachable(reachable, m_residentSurfaces);
+  auto residentVolumes = retainReachable(reachableVolumes, m_residentVolumes);
+  auto residentGroups = retainReachable(reachableGroups, m_residentGroups);
+  for (auto &g : residentGroups)
+    g->updateMergedCyclesMesh();
+
+  if (state.currentWorld != this) {
+    if (state.currentWorld)
+      state.currentWorld->releaseCyclesWorldObjects();
+    state.currentWorld = this;
+  }
+
+  std::unordered_set<const Instance *> seen;
+  for (auto *i : instances) {
+    i->syncCyclesObjects();
+    seen.insert(i);
   }
 
+  for (auto &i : m_syncedInstances) {
+    if (seen.count(i.ptr) == 0)
+      i->releaseCyclesObjects();
+  }
+
+  m_syncedInstances.assign(instances.begin(), instances.end());
+
+  // Objects referencing them are gone now, so unreachable surfaces, volumes
+  // and groups can drop their Cycles nodes
+  releaseUnreachable(m_residentSurfaces, residentSurfaces);
+  releaseUnreachable(m_residentVolumes, residentVolumes);
+  releaseUnreachable(m_residentGroups, residentGroups);
+
+  m_residentSurfaces = std::move(residentSurfaces);
+  m_residentVolumes = std::move(residentVolumes);
+  m_residentGroups = std::move(residentGroups);
+
   // Handle HDRI light management after objects are set up
   setupHDRIBackground();
+}
+
+void World::releaseCyclesWorldObjects()
+{
+  for (auto &i : m_syncedInstances)
+    i->releaseCyclesObjects();
+  m_syncedInstances.clear();
+
+  for (auto &s : m_residentSurfaces)
+    s->releaseCyclesResidency();
+  m_residentSurfaces.clear();
+
+  for (auto &v : m_residentVolumes)
+    v->releaseCyclesResidency();
+  m_residentVolumes.clear();
+
+  for (auto &g : m_residentGroups)
+    g->releaseCyclesResidency();
+  m_residentGroups.clear();
+}
 
-  scene->object_manager->tag_update(scene, ObjectManager::UPDATE_ALL);
-  scene->geometry_manager->tag_update(scene, GeometryManager::UPDATE_ALL);
-  scene->light_manager->tag_update(scene, ccl::LightManager::UPDATE_ALL);
-  scene->shader_manager->tag_update(scene, ShaderManager::UPDATE_ALL);
+void World::updateCyclesLightTransforms()
+{
+  for (auto &i : m_syncedInstances)
+    i->updateCyclesLightTransforms();
 }
 
 Light *World::findFirstHDRILight() const
@@ -165,12 +274,45 @@ void World::setupHDRIBackground()
   // Find first HDRI light from the world
   if (Light *hdriLight = findFirstHDRILight()) {
     // Set the new HDRI background
-    deviceState()->scene->background->set_shader(hdriLight->cyclesShader());
-    deviceState()->scene->background->tag_update(deviceState()->scene);
+    // Re-tagging the background rebuilds its importance sampling tables, so
+    // only do it when the shader or its visibility actually changed. A hidden
+    // HDRI still lights the scene, camera rays which miss see black.
+    auto *background = deviceState()->scene->background;
+    background->set_shader(hdriLight->cyclesShader());
+    background->set_visibility(hdriLight->visibleToCamera()
+            ? ccl::PATH_RAY_ALL_VISIBILITY
+            : ccl::PATH_RAY_ALL_VISIBILITY & ~ccl::PATH_RAY_CAMERA);
+    if (background->is_modified())
+      background->tag_update(deviceState()->scene);
   } else {
     // Clear any existing HDRI background first
-    deviceState()->scene->background->set_shader(nullptr);
+    auto *background = deviceState()->scene->background;
+    background->set_shader(nullptr);
+    background->set_visibility(ccl::PATH_RAY_ALL_VISIBILITY);
+    if (background->is_modified())
+      background->tag_update(deviceState()->scene);
+  }
+}
+
+std::vector<Instance *> World::reachableInstances() const
+{
+  std::vector<Instance *> instances;
+  std::unordered_set<const Instance *> seen;
+
+  auto addInstance = [&](Instance *i) {
+    if (i && seen.insert(i).second)
+      instances.push_back(i);
+  };
+
+  addInstance(m_zeroInstance.ptr);
+
+  if (m_instanceData) {
+    auto **instancesBegin = (Instance **)m_instanceData->handlesBegin();
+    auto **instancesEnd = (Instance **)m_instanceData->handlesEnd();
+    std::for_each(instancesBegin, instancesEnd, addInstance);
   }
+
+  return instances;
 }
 
 box3 World::bounds() const
@@ -22,6 +22,8 @@ struct World : public Object
   void finalize() override;
 
   void setCyclesWorldObjects();
+  void releaseCyclesWorldObjects();
+  void updateCyclesLightTransforms();
 
   Light *findFirstHDRILight() const;
 
@@ -29,6 +31,7 @@ struct World : public Object
 
  private:
   void setupHDRIBackground();
+  std::vector<Instance *> reachableInstances() const;
   helium::ChangeObserverPtr<ObjectArray> m_zeroSurfaceData;
   helium::ChangeObserverPtr<ObjectArray> m_zeroLightData;
   helium::ChangeObserverPtr<ObjectArray> m_zeroVolumeData;
@@ -36,6 +39,15 @@ struct World : public Object
   helium::IntrusivePtr<Instance> m_zeroInstance;
 
   helium::IntrusivePtr<ObjectArray> m_instanceData;
+
+  // Instances which had their objects placed by the last sync
+  std::vector<helium::IntrusivePtr<Instance>> m_syncedInstances;
+  // Surfaces this world holds a residency reference on
+  std::vector<helium::IntrusivePtr<Surface>> m_residentSurfaces;
+  // Volumes this world holds a residency reference on
+  std::vector<helium::IntrusivePtr<Volume>> m_residentVolumes;
+  // Groups this world holds a residency reference on, for merged meshes
+  std::vector<helium::IntrusivePtr<Group>> m_residentGroups;
 };
 
 } // namespace anari_cycles
@@ -0,0 +1,157 @@
+// Copyright 2025 Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "Array.h"
+#include "cycles_math.h"
+// cycles
+#include "util/tbb.h"
+// std
+#include <algorithm>
+#include <cstdint>
+
+namespace anari_cycles {
+
+// Number of elements each TBB task converts, large enough to amortize the
+// scheduling cost and to let the inner loops vectorize
+constexpr size_t CONVERSION_GRAIN_SIZE = 16 * 1024;
+
+// Calls f(begin, end) over [0, n) in parallel, split into contiguous chunks
+template <typename F>
+inline void parallelForChunks(size_t n, F &&f)
+{
+  if (n <= CONVERSION_GRAIN_SIZE) {
+    f(size_t(0), n);
+    return;
+  }
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, n, CONVERSION_GRAIN_SIZE),
+      [&](const tbb::blocked_range<size_t> &r) { f(r.begin(), r.end()); });
+}
+
+namespace detail {
+
+template <typename DST>
+inline DST fromFloat4(const float *v);
+
+template <>
+inline float fromFloat4<float>(const float *v)
+{
+  return v[0];
+}
+
+template <>
+inline float2 fromFloat4<float2>(const float *v)
+{
+  return make_float2(v[0], v[1]);
+}
+
+template <>
+inline float3 fromFloat4<float3>(const float *v)
+{
+  return make_float3(v[0], v[1], v[2]);
+}
+
+template <>
+inline float4 fromFloat4<float4>(const float *v)
+{
+  return make_float4(v[0], v[1], v[2], v[3]);
+}
+
+// Converts a whole array from ANARI type SRC to the Cycles type DST. The
+// source type is resolved once per array by convertArray(), so the per-element
+// work below is fully specialized and free of any runtime type switch.
+template <typename DST>
+struct ConvertArray
+{
+  template <int SRC>
+  struct To
+  {
+    void operator()(const void *src,
+        size_t srcCount,
+        DST *dst,
+        size_t count,
+        const uint32_t *gather) const
+    {
+      if constexpr (anari::isObject(SRC) || SRC == ANARI_UNKNOWN) {
+        std::fill(dst, dst + count, DST{});
+      } else {
+        using props = anari::ANARITypeProperties<SRC>;
+        using base_type = typename props::base_type;
+        constexpr int nc = props::components;
+        const auto *in = (const base_type *)src;
+        parallelForChunks(count, [&](size_t begin, size_t end) {
+          for (size_t i = begin; i < end; i++) {
+            const size_t idx = gather ? size_t(gather[i]) : i;
+            if (idx >= srcCount) {
+              dst[i] = DST{};
+              continue;
+            }
+            float v[4] = {0.f, 0.f, 0.f, 1.f};
+            props::toFloat4(v, in + nc * idx);
+            dst[i] = fromFloat4<DST>(v);
+          }
+        });
+      }
+    }
+  };
+};
+
+} // namespace detail
+
+// Converts 'count' elements of 'array' into 'dst'. Element i is read from
+// gather[i] when a gather index is given, otherwise from index i, and any
+// element whose index is past the end of the source is default initialized.
+template <typename DST>
+inline void convertArray(const Array1D *array,
+    DST *dst,
+    size_t count,
+    const uint32_t *gather = nullptr)
+{
+  size_t n = count;
+  if (!gather) {
+    n = std::min(count, array->size());
+    std::fill(dst + n, dst + count, DST{});
+  }
+
+  anari::anariTypeInvoke<void, detail::ConvertArray<DST>::template To>(
+      array->elementType(), array->data(), array->size(), dst, n, gather);
+}
+
+// Converts a single value of ANARI type 'type' to DST
+template <typename DST>
+inline DST convertValue(anari::DataType type, const void *src)
+{
+  DST dst{};
+  anari::anariTypeInvoke<void, detail::ConvertArray<DST>::template To>(
+      type, src, size_t(1), &dst, size_t(1), (const uint32_t *)nullptr);
+  return dst;
+}
+
+// Normalized float value of a scalar voxel, matching what Cycles samples
+inline float voxelValue(const uint8_t *v)
+{
+  return *v * (1.f / 255.f);
+}
+
+inline float voxelValue(const uint16_t *v)
+{
+  return *v * (1.f / 65535.f);
+}
+
+inline float voxelValue(const int16_t *v)
+{
+  return std::max(*v * (1.f / 32767.f), -1.f);
+}
+
+inline float voxelValue(const float *v)
+{
+  return *v;
+}
+
+inline float voxelValue(const double *v)
+{
+  return float(*v);
+}
+
+} // namespace anari_cycles
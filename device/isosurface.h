@@ -0,0 +1,287 @@
+// Copyright 2025 Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "array_conversion.h"
+// tbb
+#include <tbb/parallel_sort.h>
+// std
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace anari_cycles {
+
+// Scalars on a regular grid, stored x fastest
+struct IsosurfaceGrid
+{
+  const void *data{nullptr};
+  anari::DataType type{ANARI_UNKNOWN};
+  uint32_t dims[3]{0, 0, 0};
+  float3 origin{0.f, 0.f, 0.f};
+  float3 spacing{1.f, 1.f, 1.f};
+};
+
+// Indexed triangles of one extracted isosurface, with normals taken from the
+// field gradient
+struct IsosurfaceMesh
+{
+  std::vector<float3> vertices;
+  std::vector<float3> normals;
+  std::vector<int> triangles;
+  box3 bounds{empty_box3()};
+};
+
+namespace detail {
+
+// Cells per brick edge, so the voxels a task touches stay in cache
+constexpr uint32_t ISOSURFACE_BRICK_SIZE = 16;
+
+// Corners of a cell are numbered x | y << 1 | z << 2. Splitting every cell
+// into the six tetrahedra around its 0-7 diagonal gives matching faces
+// between neighbors, so the surface has no cracks.
+constexpr uint8_t CELL_TETRAHEDRA[6][4] = {{0, 1, 3, 7},
+    {0, 3, 2, 7},
+    {0, 2, 6, 7},
+    {0, 6, 4, 7},
+    {0, 4, 5, 7},
+    {0, 5, 1, 7}};
+
+template <typename T>
+struct GridAccess
+{
+  const T *data;
+  uint32_t nx, ny, nz;
+
+  size_t index(uint32_t x, uint32_t y, uint32_t z) const
+  {
+    return x + size_t(nx) * (y + size_t(ny) * z);
+  }
+
+  float value(uint32_t x, uint32_t y, uint32_t z) const
+  {
+    return voxelValue(data + index(x, y, z));
+  }
+
+  // Central differences, one-sided at the borders
+  float3 gradient(uint32_t x, uint32_t y, uint32_t z) const
+  {
+    auto axis = [&](uint32_t c, uint32_t n, auto at) {
+      const uint32_t lo = c > 0 ? c - 1 : c;
+      const uint32_t hi = c + 1 < n ? c + 1 : c;
+      return hi > lo ? (at(hi) - at(lo)) / float(hi - lo) : 0.f;
+    };
+    return make_float3(
+        axis(x, nx, [&](uint32_t i) { return value(i, y, z); }),
+        axis(y, ny, [&](uint32_t i) { return value(x, i, z); }),
+        axis(z, nz, [&](uint32_t i) { return value(x, y, i); }));
+  }
+};
+
+// Vertices sit on cell and tetrahedron edges, which all run from a voxel in
+// one of seven positive directions. The voxel index and direction make a key
+// unique across the grid, letting vertices be shared between cells.
+inline uint64_t edgeKey(size_t voxel, uint32_t a, uint32_t b)
+{
+  return uint64_t(voxel) * 8 + ((a ^ b) & 7);
+}
+
+template <typename T>
+void collectEdgeKeys(const GridAccess<T> &grid,
+    float isovalue,
+    uint32_t bx,
+    uint32_t by,
+    uint32_t bz,
+    std::vector<uint64_t> &keys)
+{
+  const uint32_t x1 = std::min(bx + ISOSURFACE_BRICK_SIZE, grid.nx - 1);
+  const uint32_t y1 = std::min(by + ISOSURFACE_BRICK_SIZE, grid.ny - 1);
+  const uint32_t z1 = std::min(bz + ISOSURFACE_BRICK_SIZE, grid.nz - 1);
+
+  for (uint32_t z = bz; z < z1; z++) {
+    for (uint32_t y = by; y < y1; y++) {
+      for (uint32_t x = bx; x < x1; x++) {
+        float v[8];
+        uint32_t below = 0;
+        for (uint32_t c = 0; c < 8; c++) {
+          v[c] = grid.value(x + (c & 1), y + ((c >> 1) & 1), z + (c >> 2));
+          below += v[c] < isovalue;
+        }
+        if (below == 0 || below == 8)
+          continue;
+
+        // Corners of a tetrahedron are nested bit sets, so the lower end of
+        // any of its edges is the corner both ends share
+        auto key = [&](uint32_t a, uint32_t b) {
+          const uint32_t lo = a & b;
+          const size_t voxel =
+              grid.index(x + (lo & 1), y + ((lo >> 1) & 1), z + (lo >> 2));
+          return edgeKey(voxel, a, b);
+        };
+
+        for (const auto &tet : CELL_TETRAHEDRA) {
+          uint32_t in[4], out[4];
+          uint32_t numIn = 0, numOut = 0;
+          for (uint32_t c : tet) {
+            if (v[c] < isovalue)
+              in[numIn++] = c;
+            else
+              out[numOut++] = c;
+          }
+
+          if (numIn == 1 || numOut == 1) {
+            const uint32_t apex = numIn == 1 ? in[0] : out[0];
+            const uint32_t *others = numIn == 1 ? out : in;
+            for (uint32_t k = 0; k < 3; k++)
+              keys.push_back(key(apex, others[k]));
+          } else if (numIn == 2) {
+            const uint64_t quad[4] = {key(in[0], out[0]),
+                key(in[0], out[1]),
+                key(in[1], out[1]),
+                key(in[1], out[0])};
+            keys.insert(keys.end(), {quad[0], quad[1], quad[2]});
+            keys.insert(keys.end(), {quad[0], quad[2], quad[3]});
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+IsosurfaceMesh extractIsosurface(
+    const IsosurfaceGrid &g, const T *data, float isovalue)
+{
+  IsosurfaceMesh mesh;
+  const GridAccess<T> grid{data, g.dims[0], g.dims[1], g.dims[2]};
+  if (grid.nx < 2 || grid.ny < 2 || grid.nz < 2)
+    return mesh;
+
+  // Each brick collects the edge keys of its triangle corners on its own...
+  auto numBricks = [](uint32_t n) {
+    return (n - 1 + ISOSURFACE_BRICK_SIZE - 1) / ISOSURFACE_BRICK_SIZE;
+  };
+  const uint32_t bricks[3] = {
+      numBricks(grid.nx), numBricks(grid.ny), numBricks(grid.nz)};
+  const size_t totalBricks = size_t(bricks[0]) * bricks[1] * bricks[2];
+
+  std::vector<std::vector<uint64_t>> brickKeys(totalBricks);
+  tbb::parallel_for(size_t(0), totalBricks, [&](size_t b) {
+    const uint32_t bx = uint32_t(b % bricks[0]);
+    const uint32_t by = uint32_t((b / bricks[0]) % bricks[1]);
+    const uint32_t bz = uint32_t(b / (size_t(bricks[0]) * bricks[1]));
+    collectEdgeKeys(grid,
+        isovalue,
+        bx * ISOSURFACE_BRICK_SIZE,
+        by * ISOSURFACE_BRICK_SIZE,
+        bz * ISOSURFACE_BRICK_SIZE,
+        brickKeys[b]);
+  });
+
+  // ...which are then concatenated in brick order...
+  std::vector<size_t> offsets(totalBricks + 1, 0);
+  for (size_t b = 0; b < totalBricks; b++)
+    offsets[b + 1] = offsets[b] + brickKeys[b].size();
+
+  std::vector<uint64_t> corners(offsets[totalBricks]);
+  tbb::parallel_for(size_t(0), totalBricks, [&](size_t b) {
+    std::copy(brickKeys[b].begin(),
+        brickKeys[b].end(),
+        corners.begin() + offsets[b]);
+    std::vector<uint64_t>().swap(brickKeys[b]);
+  });
+
+  // ...and every unique edge becomes one shared vertex
+  std::vector<uint64_t> edges = corners;
+  tbb::parallel_sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  mesh.vertices.resize(edges.size());
+  mesh.normals.resize(edges.size());
+  parallelForChunks(edges.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const size_t voxel = edges[i] / 8;
+      const uint32_t dir = uint32_t(edges[i] % 8);
+      const uint32_t x0 = uint32_t(voxel % grid.nx);
+      const uint32_t y0 = uint32_t((voxel / grid.nx) % grid.ny);
+      const uint32_t z0 = uint32_t(voxel / (size_t(grid.nx) * grid.ny));
+      const uint32_t x1 = x0 + (dir & 1);
+      const uint32_t y1 = y0 + ((dir >> 1) & 1);
+      const uint32_t z1 = z0 + (dir >> 2);
+
+      const float v0 = grid.value(x0, y0, z0);
+      const float v1 = grid.value(x1, y1, z1);
+      const float t =
+          v1 != v0 ? std::clamp((isovalue - v0) / (v1 - v0), 0.f, 1.f) : 0.5f;
+
+      const float3 p0 = make_float3(float(x0), float(y0), float(z0));
+      const float3 p1 = make_float3(float(x1), float(y1), float(z1));
+      mesh.vertices[i] = g.origin + (p0 + (p1 - p0) * t) * g.spacing;
+
+      // Normals point from high to low values, scaled into world space
+      const float3 grad = grid.gradient(x0, y0, z0) * (1.f - t)
+          + grid.gradient(x1, y1, z1) * t;
+      const float3 n = -grad / g.spacing;
+      const float len = ccl::len(n);
+      mesh.normals[i] = len > 0.f ? n / len : make_float3(0.f, 0.f, 1.f);
+    }
+  });
+
+  const size_t numTriangles = corners.size() / 3;
+  mesh.triangles.resize(corners.size());
+  parallelForChunks(numTriangles, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      int *tri = &mesh.triangles[3 * t];
+      for (size_t k = 0; k < 3; k++) {
+        const uint64_t key = corners[3 * t + k];
+        tri[k] = int(std::lower_bound(edges.begin(), edges.end(), key)
+            - edges.begin());
+      }
+
+      // Tetrahedron cases don't fix a winding, so face the triangle along
+      // the normals of its vertices
+      const float3 &a = mesh.vertices[tri[0]];
+      const float3 &b = mesh.vertices[tri[1]];
+      const float3 &c = mesh.vertices[tri[2]];
+      const float3 n = mesh.normals[tri[0]] + mesh.normals[tri[1]]
+          + mesh.normals[tri[2]];
+      if (dot(cross(b - a, c - a), n) < 0.f)
+        std::swap(tri[1], tri[2]);
+    }
+  });
+
+  for (const auto &v : mesh.vertices)
+    extend(mesh.bounds, v);
+
+  return mesh;
+}
+
+} // namespace detail
+
+// Extracts the surface where 'grid' crosses 'isovalue' with marching
+// tetrahedra, processing the grid in parallel one cache-sized brick at a time
+inline IsosurfaceMesh extractIsosurface(
+    const IsosurfaceGrid &grid, float isovalue)
+{
+  switch (grid.type) {
+  case ANARI_UFIXED8:
+    return detail::extractIsosurface(
+        grid, (const uint8_t *)grid.data, isovalue);
+  case ANARI_UFIXED16:
+    return detail::extractIsosurface(
+        grid, (const uint16_t *)grid.data, isovalue);
+  case ANARI_FIXED16:
+    return detail::extractIsosurface(
+        grid, (const int16_t *)grid.data, isovalue);
+  case ANARI_FLOAT32:
+    return detail::extractIsosurface(grid, (const float *)grid.data, isovalue);
+  case ANARI_FLOAT64:
+    return detail::extractIsosurface(
+        grid, (const double *)grid.data, isovalue);
+  default:
+    return {};
+  }
+}
+
+} // namespace anari_cycles
@@ -0,0 +1,74 @@
+// Copyright 2025 Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "array_conversion.h"
+// tbb
+#include <tbb/parallel_sort.h>
+// std
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace anari_cycles {
+
+namespace detail {
+
+// Spreads the low 10 bits of v so there are two zero bits between each
+inline uint32_t expandBits10(uint32_t v)
+{
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// 30-bit Morton code of a point already normalized to [0, 1]
+inline uint32_t mortonCode(float3 p)
+{
+  auto quantize = [](float v) {
+    return uint32_t(std::clamp(v * 1024.f, 0.f, 1023.f));
+  };
+  return (expandBits10(quantize(p.x)) << 2)
+      | (expandBits10(quantize(p.y)) << 1) | expandBits10(quantize(p.z));
+}
+
+} // namespace detail
+
+// Returns the indices of 'points' ordered along a Morton curve through their
+// bounding box, so that consecutive indices are spatially close
+inline std::vector<uint32_t> mortonOrder(const float3 *points, size_t count)
+{
+  box3 bounds = empty_box3();
+  for (size_t i = 0; i < count; i++)
+    extend(bounds, points[i]);
+
+  const float3 extent = bounds.upper - bounds.lower;
+  const float3 scale = make_float3(extent.x > 0.f ? 1.f / extent.x : 0.f,
+      extent.y > 0.f ? 1.f / extent.y : 0.f,
+      extent.z > 0.f ? 1.f / extent.z : 0.f);
+
+  // Code in the upper half, index in the lower, so one sort of plain
+  // integers orders the indices and keeps equal codes stable
+  std::vector<uint64_t> keys(count);
+  parallelForChunks(count, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const uint32_t code =
+          detail::mortonCode((points[i] - bounds.lower) * scale);
+      keys[i] = (uint64_t(code) << 32) | uint64_t(i);
+    }
+  });
+
+  tbb::parallel_sort(keys.begin(), keys.end());
+
+  std::vector<uint32_t> order(count);
+  parallelForChunks(count, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      order[i] = uint32_t(keys[i]);
+  });
+  return order;
+}
+
+} // namespace anari_cycles